@@ -24,256 +24,4486 @@
 #include <iostream>
 #include <fstream>
 #include <string>
-#include <iomanip>
 #include <map>
 #include <vector>
 #include <array>
-#include <random>
 #include <limits>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <charconv>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <coroutine>
+#include <unordered_map>
+#include <filesystem>
+#include <thread>
+#include <condition_variable>
+#include <algorithm>
+#include <bit>
+#include <memory_resource>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
 
 using namespace std;
 
 const int TABLE_QTY = 4;
 const int TABLE_CAPACITY = 4;
-const double TAX_RATE = 0.10;
-const double TIP_RATE = 0.20;
+const int MAX_PARTY = 32; // most guests one batch command or terminal request can seat
+const int TERMINAL_ID = 1;
+const char* const TRANSACTION_HWM_FILE = "transaction.hwm";
+const char* const RECEIPT_JOURNAL_PREFIX = "receipts";
+const long RECEIPT_SEGMENT_BYTES = 64L << 20;
+const size_t RECEIPT_QUEUE_CAPACITY = 4096;
+const size_t RECEIPT_FILES_OPEN = 64; // receipt files held open awaiting a group fsync
+const size_t INPUT_BLOCK_BYTES = 1 << 16;
+const size_t COMMAND_RING_CAPACITY = 1 << 14;
+const size_t PIPELINE_DEPTH = 64; // commands a terminal may have in flight
+const size_t MAX_FRAME_BYTES = 256;
+const size_t FRAME_POOL_BUCKETS = 16; // pooled coroutine frames up to 1 KiB
+const size_t MAX_MENU_ITEMS = 4096;
+const size_t MENU_PAGE_ITEMS = 20;
+const size_t MENU_VERSION_SLOTS = 1024; // menu versions that may be in use at once
+const size_t DAY_ARENA_BLOCK_BYTES = 64 << 10;
+const size_t KITCHEN_SWEEP_MIN = 1024; // stale tickets worth sweeping the heaps for
+const uint64_t SNAPSHOT_EVERY_EVENTS = 100000; // logged events between state snapshots
+const int SERVER_MAX_EVENTS = 256;
 
-enum Entrees { RAW_FISH, EGGS, HAM, BISC, TOAST };
+enum class Rounding { HALF_UP, HALF_EVEN, DOWN, UP };
 
-const array<string, 5> entreeNames = {"Raw Fish", "Eggs", "Ham", "Biscuits", "Toast"};
-const array<int, 5> entreePrices = {35, 45, 38, 38, 38};
+// Rates are held in basis points (1/100 of a percent) so they can be applied
+// to whole cents exactly, with an explicit rule for the leftover fraction.
+struct Rate {
+    int64_t basisPoints;
+    Rounding rounding;
+};
+
+const Rate TAX_RATE = {1000, Rounding::HALF_UP};
+const Rate TIP_RATE = {2000, Rounding::HALF_UP};
+
+// Fixed-point currency amount in whole cents.
+struct Money {
+    int64_t cents = 0;
+
+    static constexpr Money dollars(int64_t amount) { return {amount * 100}; }
+
+    Money operator+(Money other) const { return {cents + other.cents}; }
+    Money& operator+=(Money other) { cents += other.cents; return *this; }
+    Money operator*(int64_t qty) const { return {cents * qty}; }
+
+    Money applied(Rate rate) const {
+        bool negative = cents < 0;
+        uint64_t scaled = uint64_t(negative ? -cents : cents) * uint64_t(rate.basisPoints);
+        uint64_t whole = scaled / 10000, rest = scaled % 10000;
+        switch (rate.rounding) {
+            case Rounding::HALF_UP:   whole += rest * 2 >= 10000; break;
+            case Rounding::HALF_EVEN: whole += rest * 2 > 10000 || (rest * 2 == 10000 && (whole & 1)); break;
+            case Rounding::UP:        whole += rest != 0; break;
+            case Rounding::DOWN:      break;
+        }
+        return {negative ? -int64_t(whole) : int64_t(whole)};
+    }
+
+    // Parses "D", "D.C" or "D.CC" (no sign, no more than two decimals).
+    static bool parse(string_view text, Money& money) {
+        size_t dot = text.find('.');
+        string_view whole = text.substr(0, dot), fraction = dot == string_view::npos ? "" : text.substr(dot + 1);
+        int64_t units = 0, hundredths = 0;
+        if (whole.empty() || fraction.size() > 2 || (dot != string_view::npos && fraction.empty())) return false;
+        if (whole[0] < '0' || whole[0] > '9') return false; // from_chars would take a '-'
+        auto parsed = from_chars(whole.data(), whole.data() + whole.size(), units);
+        if (parsed.ec != errc() || parsed.ptr != whole.data() + whole.size()) return false;
+        for (char digit : fraction) {
+            if (digit < '0' || digit > '9') return false;
+            hundredths = hundredths * 10 + (digit - '0');
+        }
+        if (fraction.size() == 1) hundredths *= 10;
+        money.cents = units * 100 + hundredths;
+        return true;
+    }
+
+    // Writes the amount as "D.CC" into buf without allocating and returns the
+    // number of characters written. 24 bytes always suffice.
+    size_t format(char* buf) const {
+        char* p = buf;
+        uint64_t magnitude = cents < 0 ? 0 - uint64_t(cents) : uint64_t(cents);
+        if (cents < 0) *p++ = '-';
+        p = to_chars(p, buf + 21, magnitude / 100).ptr;
+        *p++ = '.';
+        *p++ = char('0' + magnitude % 100 / 10);
+        *p++ = char('0' + magnitude % 10);
+        return size_t(p - buf);
+    }
+};
+
+ostream& operator<<(ostream& out, Money amount) {
+    char buf[24];
+    return out.write(buf, amount.format(buf));
+}
+
+// Growable text buffer with allocation-free number formatting. The storage is
+// reused after clear(), so rendering a screen or receipt stops allocating
+// once the buffer has grown to size.
+class TextBuffer {
+public:
+    TextBuffer& operator<<(string_view text) { data.append(text); return *this; }
+    TextBuffer& operator<<(char c) { data.push_back(c); return *this; }
+
+    template <typename Int, enable_if_t<is_integral_v<Int>, int> = 0>
+    TextBuffer& operator<<(Int value) {
+        char buf[24];
+        return *this << string_view(buf, size_t(to_chars(buf, buf + sizeof(buf), value).ptr - buf));
+    }
+
+    TextBuffer& operator<<(double value) {
+        char buf[32];
+        auto end = to_chars(buf, buf + sizeof(buf), value, chars_format::fixed, 3).ptr;
+        return *this << string_view(buf, size_t(end - buf));
+    }
+
+    TextBuffer& operator<<(Money amount) {
+        char buf[24];
+        return *this << string_view(buf, amount.format(buf));
+    }
+
+    const string& str() const { return data; }
+    size_t size() const { return data.size(); }
+    void clear() { data.clear(); }
+
+private:
+    string data;
+};
+
+// Console output assembled into a buffer and handed to the OS in one write,
+// normally right before the program blocks for input. In quiet mode nothing
+// is rendered at all, so headless runs measure only the business logic.
+// Interactive error messages still go to cerr, after flushing the console so
+// they appear in order.
+class Console {
+public:
+    explicit Console(int fd) : fd(fd) {}
+    ~Console() { flush(); }
+
+    bool quiet = false;
+
+    template <typename T>
+    Console& operator<<(const T& value) {
+        if (quiet) return *this;
+        text << value;
+        if (text.size() >= FLUSH_THRESHOLD) flush();
+        return *this;
+    }
+
+    void flush() {
+        const char* p = text.str().data();
+        size_t left = text.size();
+        while (left > 0) {
+#ifdef _WIN32
+            long n = _write(fd, p, unsigned(left));
+#else
+            long n = write(fd, p, left);
+#endif
+            if (n <= 0) break;
+            p += n;
+            left -= size_t(n);
+        }
+        text.clear();
+    }
+
+private:
+    static const size_t FLUSH_THRESHOLD = 1 << 16;
+
+    const int fd;
+    TextBuffer text;
+};
+
+Console console(1);
+Console consoleErr(2);
+
+// A line of a comma-separated setup file (menu, recipes, kitchen), split at
+// its first and last commas. With one comma, middle is empty; with none,
+// head is the whole line.
+struct CsvLine {
+    size_t number = 0;
+    int commas = 0; // 2 stands for two or more
+    string_view head, middle, tail;
+};
+
+// Calls row(line) for every line of the file that is neither blank nor a '#'
+// comment, stopping at the first row that returns false. A row that fails
+// sets error, usually through csvError().
+template <typename Fn>
+bool readCsv(const string& path, string& error, Fn&& row) {
+    ifstream in(path);
+    if (!in) {
+        error = "cannot open '" + path + "'";
+        return false;
+    }
+    string text;
+    for (size_t lineNo = 1; getline(in, text); ++lineNo) {
+        if (!text.empty() && text.back() == '\r') text.pop_back();
+        if (text.empty() || text[0] == '#') continue;
+        string_view view(text);
+        size_t first = view.find(','), last = view.rfind(',');
+        CsvLine line;
+        line.number = lineNo;
+        line.commas = first == string_view::npos ? 0 : first == last ? 1 : 2;
+        line.head = view.substr(0, first);
+        if (line.commas == 2) line.middle = view.substr(first + 1, last - first - 1);
+        if (line.commas > 0) line.tail = view.substr(last + 1);
+        if (!row(line)) return false;
+    }
+    return true;
+}
+
+string csvError(const string& path, const CsvLine& line, const string& problem) {
+    return path + ": line " + to_string(line.number) + ": " + problem;
+}
+
+// Parses the whole of field as a number.
+template <typename T>
+bool parseField(string_view field, T& value) {
+    auto parsed = from_chars(field.data(), field.data() + field.size(), value);
+    return parsed.ec == errc() && parsed.ptr == field.data() + field.size();
+}
+
+// Position of an item in the menu catalog. Orders, commands and kitchen
+// code use positions; item codes (SKUs) are only for people and storage.
+using Entrees = uint16_t;
+const Entrees NO_ITEM = 0xFFFF;
+
+// One version of the menu. Items sit contiguously in file order with their
+// names in one shared buffer, so the name or price of an item is a plain
+// array index. Item codes (SKUs) map to positions through a minimal perfect
+// hash built at load time (hash-and-displace): keys are hashed into small
+// buckets, and each bucket, largest first, gets the first seed that sends all
+// of its keys to distinct free slots. A lookup is two hashes and two array
+// reads with no probing; one final compare rejects unknown codes.
+class MenuCatalog {
+public:
+    // The original five-item menu, used when no menu file is given.
+    static MenuCatalog builtIn() {
+        MenuCatalog menu;
+        const pair<const char*, int> defaults[] = {{"Raw Fish", 35}, {"Eggs", 45}, {"Ham", 38}, {"Biscuits", 38}, {"Toast", 38}};
+        uint32_t sku = 0;
+        for (const auto& [name, dollars] : defaults)
+            menu.add(++sku, name, Money::dollars(dollars));
+        menu.buildIndex();
+        return menu;
+    }
+
+    // Reads "<sku>,<name>,<price>" lines; '#' starts a comment line. SKUs must
+    // be unique and fit a positive int, since terminals and batch commands
+    // read item numbers as ints.
+    static bool load(const string& path, MenuCatalog& menu, string& error) {
+        MenuCatalog loaded;
+        bool read = readCsv(path, error, [&](const CsvLine& line) {
+            uint32_t sku = 0;
+            Money price;
+            if (line.commas != 2 || line.middle.empty() || !parseField(line.head, sku) || sku == 0
+                || sku > uint32_t(INT32_MAX) || !Money::parse(line.tail, price)) {
+                error = csvError(path, line, "expected <sku>,<name>,<price>");
+                return false;
+            }
+            if (loaded.items.size() == MAX_MENU_ITEMS) {
+                error = path + ": more than " + to_string(MAX_MENU_ITEMS) + " items";
+                return false;
+            }
+            loaded.add(sku, line.middle, price);
+            return true;
+        });
+        if (!read) return false;
+        if (loaded.items.empty()) {
+            error = path + ": no menu items";
+            return false;
+        }
+        vector<uint32_t> skus;
+        for (const Item& item : loaded.items)
+            skus.push_back(item.sku);
+        sort(skus.begin(), skus.end());
+        auto duplicate = adjacent_find(skus.begin(), skus.end());
+        if (duplicate != skus.end()) {
+            error = path + ": duplicate SKU " + to_string(*duplicate);
+            return false;
+        }
+        loaded.buildIndex();
+        menu = move(loaded);
+        return true;
+    }
+
+    size_t size() const { return items.size(); }
+    uint32_t version() const { return menuVersion; }
+    uint32_t sku(Entrees item) const { return items[item].sku; }
+    Money price(Entrees item) const { return items[item].price; }
+    bool available(Entrees item) const { return items[item].available; }
+    string_view name(Entrees item) const { return string_view(names).substr(items[item].nameOffset, items[item].nameLength); }
+    uint32_t minSku() const { return lowestSku; }
+    uint32_t maxSku() const { return highestSku; }
+
+    Entrees find(uint32_t sku) const {
+        if (slots.empty()) return NO_ITEM;
+        uint32_t seed = seeds[hash(sku, 0) % seeds.size()];
+        Entrees item = slots[hash(sku, seed) % slots.size()];
+        return items[item].sku == sku ? item : NO_ITEM;
+    }
+
+    // Edits for a copy that has not been published yet (see MenuBoard).
+    void setPrice(Entrees item, Money price) { items[item].price = price; }
+    void setAvailable(Entrees item, bool available) { items[item].available = available; }
+
+private:
+    friend class MenuBoard;
+
+    struct Item {
+        uint32_t sku;
+        uint32_t nameOffset;
+        uint16_t nameLength;
+        Money price;
+        bool available = true; // false once the item is 86'd
+    };
+
+    static uint64_t hash(uint64_t key, uint64_t seed) {
+        // splitmix64 finaliser
+        key += 0x9E3779B97F4A7C15ull * (seed + 1);
+        key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ull;
+        key = (key ^ (key >> 27)) * 0x94D049BB133111EBull;
+        return key ^ (key >> 31);
+    }
+
+    void add(uint32_t sku, string_view name, Money price) {
+        items.push_back({sku, uint32_t(names.size()), uint16_t(name.size()), price});
+        names.append(name);
+        lowestSku = items.size() == 1 ? sku : min(lowestSku, sku);
+        highestSku = max(highestSku, sku);
+    }
+
+    void buildIndex() {
+        size_t n = items.size();
+        vector<vector<Entrees>> buckets(max<size_t>(1, n / 4));
+        for (size_t i = 0; i < n; ++i)
+            buckets[hash(items[i].sku, 0) % buckets.size()].push_back(Entrees(i));
+        vector<size_t> order(buckets.size());
+        for (size_t b = 0; b < order.size(); ++b)
+            order[b] = b;
+        sort(order.begin(), order.end(), [&](size_t a, size_t b) { return buckets[a].size() > buckets[b].size(); });
+
+        seeds.assign(buckets.size(), 0);
+        slots.assign(n, NO_ITEM);
+        vector<size_t> taken;
+        for (size_t b : order) {
+            if (buckets[b].empty()) break;
+            // SKUs are unique, so some seed always separates the bucket.
+            for (uint32_t seed = 1;; ++seed) {
+                taken.clear();
+                for (Entrees item : buckets[b]) {
+                    size_t slot = hash(items[item].sku, seed) % n;
+                    if (slots[slot] != NO_ITEM || std::find(taken.begin(), taken.end(), slot) != taken.end()) break;
+                    taken.push_back(slot);
+                }
+                if (taken.size() < buckets[b].size()) continue;
+                for (size_t k = 0; k < taken.size(); ++k)
+                    slots[taken[k]] = buckets[b][k];
+                seeds[b] = seed;
+                break;
+            }
+        }
+    }
+
+    vector<Item> items;
+    string names;
+    vector<uint32_t> seeds;
+    vector<Entrees> slots;
+    uint32_t lowestSku = 0, highestSku = 0;
+    uint32_t menuVersion = 0;
+};
+
+// Publishes the menu to terminals, read-copy-update style. A published
+// catalog is never modified: a manager's change edits a copy, and the copy
+// replaces the live version with one pointer swap, so terminals reading the
+// menu take no lock and never see half a change. Changes keep every item in
+// its position, so a position names the same item in every version.
+//
+// A replaced version is retired and deleted once no thread is still reading
+// it and no open order is priced against it. Each reading thread announces
+// the version it holds in a slot of its own (a hazard pointer), and each open
+// order pins the version its tab was opened under. A version's number is its
+// slot in a fixed table, so an order only has to record the number; numbers
+// are reused once their version has been reclaimed.
+class MenuBoard {
+public:
+    explicit MenuBoard(MenuCatalog first) { publish(move(first)); }
+
+    ~MenuBoard() {
+        for (atomic<const MenuCatalog*>& version : versions)
+            delete version.load();
+        for (ReaderSlot* slot = readers.load(); slot;) {
+            ReaderSlot* next = slot->next;
+            delete slot;
+            slot = next;
+        }
+    }
+
+    // Replaces the menu outright, e.g. with one read from a file. Items may
+    // move, so this is only for before any order is taken.
+    void publish(MenuCatalog next) {
+        lock_guard<mutex> guard(publishLock);
+        install(make_unique<MenuCatalog>(move(next)));
+    }
+
+    // Publishes a copy of the live menu with change(copy) applied, and
+    // reports the new version's number in published if given. Returns false,
+    // leaving the menu as it was, if every version number is still in use.
+    template <typename Fn>
+    bool update(Fn&& change, uint32_t* published = nullptr) {
+        lock_guard<mutex> guard(publishLock);
+        auto next = make_unique<MenuCatalog>(*live.load());
+        change(*next);
+        const MenuCatalog* installed = next.get();
+        if (!install(move(next))) return false;
+        if (published) *published = installed->version();
+        return true;
+    }
+
+    // The version an open order was priced against; the order's pin keeps it.
+    const MenuCatalog& at(uint32_t version) const { return *versions[version].load(memory_order_acquire); }
+
+    void pin(uint32_t version) { pins[version].fetch_add(1); }
+    void unpin(uint32_t version) { pins[version].fetch_sub(1); }
+
+private:
+    friend class MenuView;
+
+    struct alignas(64) ReaderSlot {
+        atomic<const MenuCatalog*> reading{nullptr};
+        atomic<bool> taken{true};
+        ReaderSlot* next = nullptr;
+        int depth = 0; // nested views; only the owning thread touches it
+    };
+
+    // Returns a thread's slot to the pool when the thread exits.
+    struct SlotLease {
+        ReaderSlot* slot = nullptr;
+        ~SlotLease() {
+            if (slot) slot->taken.store(false, memory_order_release);
+        }
+    };
+
+    ReaderSlot& ownSlot() {
+        thread_local SlotLease lease;
+        if (lease.slot) return *lease.slot;
+        for (ReaderSlot* slot = readers.load(); slot; slot = slot->next) {
+            bool free = false;
+            if (!slot->taken.load(memory_order_relaxed) && slot->taken.compare_exchange_strong(free, true))
+                return *(lease.slot = slot);
+        }
+        auto slot = new ReaderSlot;
+        slot->next = readers.load();
+        while (!readers.compare_exchange_weak(slot->next, slot)) {}
+        return *(lease.slot = slot);
+    }
+
+    // Announces the live version before relying on it, then checks it is
+    // still live, so the reclaimer either sees the announcement or has not
+    // retired the version yet.
+    const MenuCatalog* enter() {
+        ReaderSlot& slot = ownSlot();
+        if (slot.depth++ > 0) return slot.reading.load(memory_order_relaxed);
+        const MenuCatalog* menu = live.load();
+        for (;;) {
+            slot.reading.store(menu);
+            const MenuCatalog* now = live.load();
+            if (now == menu) return menu;
+            menu = now;
+        }
+    }
+
+    void leave() {
+        ReaderSlot& slot = ownSlot();
+        if (--slot.depth == 0) slot.reading.store(nullptr, memory_order_release);
+    }
+
+    // The caller holds publishLock.
+    bool install(unique_ptr<MenuCatalog> next) {
+        reclaim();
+        // Numbers are handed out round-robin, so a number just freed is not
+        // the next one issued.
+        size_t version = cursor;
+        while (versions[version].load()) {
+            version = (version + 1) % MENU_VERSION_SLOTS;
+            if (version == cursor) return false;
+        }
+        cursor = (version + 1) % MENU_VERSION_SLOTS;
+        next->menuVersion = uint32_t(version);
+        versions[version].store(next.get(), memory_order_release);
+        const MenuCatalog* replaced = live.exchange(next.release());
+        if (replaced) retired.push_back(replaced);
+        reclaim();
+        return true;
+    }
+
+    // Deletes retired versions nobody uses any more. Reader slots are read
+    // before pins: an order pins its version while its terminal is still
+    // announcing it, so a pin taken after the slot scan is already visible.
+    void reclaim() {
+        vector<const MenuCatalog*> reading;
+        for (ReaderSlot* slot = readers.load(); slot; slot = slot->next) {
+            if (const MenuCatalog* menu = slot->reading.load()) reading.push_back(menu);
+        }
+        erase_if(retired, [&](const MenuCatalog* menu) {
+            uint32_t version = menu->version();
+            if (pins[version].load() > 0 || std::find(reading.begin(), reading.end(), menu) != reading.end()) return false;
+            versions[version].store(nullptr);
+            delete menu;
+            return true;
+        });
+    }
+
+    atomic<const MenuCatalog*> live{nullptr};
+    array<atomic<const MenuCatalog*>, MENU_VERSION_SLOTS> versions{};
+    array<atomic<uint32_t>, MENU_VERSION_SLOTS> pins{};
+    atomic<ReaderSlot*> readers{nullptr};
+    mutex publishLock;
+    vector<const MenuCatalog*> retired; // guarded by publishLock
+    size_t cursor = 0;                  // likewise
+};
+
+MenuBoard menuBoard(MenuCatalog::builtIn());
+
+// Read access to the live menu, with no lock. The version a view sees stays
+// the same, and stays valid, for the view's lifetime; views nest on a thread.
+// Keep views short and never hold one across a co_await, or the thread would
+// keep an old version from being reclaimed.
+class MenuView {
+public:
+    MenuView() : menu(menuBoard.enter()) {}
+    ~MenuView() { menuBoard.leave(); }
+    MenuView(const MenuView&) = delete;
+    MenuView& operator=(const MenuView&) = delete;
+
+    const MenuCatalog& operator*() const { return *menu; }
+    const MenuCatalog* operator->() const { return menu; }
+
+private:
+    const MenuCatalog* menu;
+};
+
+// Portions left of each item the kitchen counts. Counters are indexed by menu
+// position, which is the same in every menu version, and change only by
+// compare-and-swap, so order entry never takes a lock. Items nobody has
+// counted are unlimited; their counters are only ever read. An item whose
+// count reaches zero drops off the menu until it is restocked.
+class Inventory {
+public:
+    static constexpr int32_t UNCOUNTED = -1;
+
+    Inventory() : counts(new atomic<int32_t>[MAX_MENU_ITEMS]) {
+        for (size_t i = 0; i < MAX_MENU_ITEMS; ++i)
+            counts[i].store(UNCOUNTED, memory_order_relaxed);
+    }
+
+    // Sets what is left of an item; UNCOUNTED stops counting it.
+    void set(Entrees item, int32_t count) { counts[item].store(count, memory_order_relaxed); }
+
+    int32_t count(Entrees item) const { return counts[item].load(memory_order_relaxed); }
+    bool inStock(Entrees item) const { return count(item) != 0; }
+
+    // Takes one portion of each item, all or none. NO_ITEM is skipped.
+    bool reserve(const Entrees* items, int n) {
+        for (int i = 0; i < n; ++i) {
+            if (!take(items[i])) {
+                for (int j = 0; j < i; ++j)
+                    release(items[j]);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void release(Entrees item) {
+        if (item == NO_ITEM) return;
+        atomic<int32_t>& left = counts[item];
+        int32_t have = left.load(memory_order_relaxed);
+        do {
+            if (have == UNCOUNTED) return;
+        } while (!left.compare_exchange_weak(have, have + 1, memory_order_relaxed));
+    }
+
+private:
+    bool take(Entrees item) {
+        if (item == NO_ITEM) return true;
+        atomic<int32_t>& left = counts[item];
+        int32_t have = left.load(memory_order_relaxed);
+        do {
+            if (have == UNCOUNTED) return true;
+            if (have == 0) return false;
+        } while (!left.compare_exchange_weak(have, have - 1, memory_order_relaxed));
+        return true;
+    }
+
+    unique_ptr<atomic<int32_t>[]> counts;
+};
+
+Inventory stock;
+
+// What each item is made of, as a sparse item-by-ingredient matrix compiled
+// into flat arrays. By rows (CSR) it lists an item's ingredients and amounts,
+// so placing an order adds to running per-ingredient consumption, and "can we
+// still make n?" reads a single row. The same matrix is also kept by columns
+// (CSC), so exploding a whole day of orders into ingredient totals is one
+// gather-multiply-add loop per ingredient over contiguous arrays, which the
+// compiler can vectorise. Amounts are whole units (grams, pieces, ...).
+class RecipeBook {
+public:
+    static constexpr int64_t UNCOUNTED = -1;
+
+    // Reads "<ingredient>,<amount on hand>" lines and
+    // "<item sku>,<ingredient>,<amount per portion>" lines; '#' starts a
+    // comment line. Ingredients without an amount on hand are not counted.
+    static bool load(const string& path, RecipeBook& book, string& error) {
+        MenuView menu;
+        RecipeBook loaded;
+        struct Entry {
+            Entrees item;
+            uint32_t ingredient;
+            int32_t amount;
+        };
+        vector<Entry> entries;
+        vector<int64_t> stocked;
+        bool read = readCsv(path, error, [&](const CsvLine& line) {
+            int64_t amount = 0;
+            uint32_t sku = 0;
+            bool stock = line.commas == 1;
+            string_view name = stock ? line.head : line.middle;
+            bool ok = line.commas > 0 && parseField(line.tail, amount) && amount >= 0 && !name.empty();
+            if (ok && !stock) ok = parseField(line.head, sku) && amount > 0 && amount <= INT32_MAX;
+            if (!ok) {
+                error = csvError(path, line, "expected <ingredient>,<amount> or <sku>,<ingredient>,<amount>");
+                return false;
+            }
+            uint32_t ingredient = loaded.intern(name);
+            stocked.resize(loaded.ingredientNames.size(), UNCOUNTED);
+            if (stock) {
+                stocked[ingredient] = amount;
+                return true;
+            }
+            Entrees item = menu->find(sku);
+            if (item == NO_ITEM) {
+                error = csvError(path, line, "no menu item " + to_string(sku));
+                return false;
+            }
+            entries.push_back({item, ingredient, int32_t(amount)});
+            return true;
+        });
+        if (!read) return false;
+
+        // Rows: by item, then ingredient, with repeated ingredients merged.
+        sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+            return a.item != b.item ? a.item < b.item : a.ingredient < b.ingredient;
+        });
+        vector<Entry> merged;
+        for (const Entry& entry : entries) {
+            if (!merged.empty() && merged.back().item == entry.item && merged.back().ingredient == entry.ingredient)
+                merged.back().amount += entry.amount;
+            else
+                merged.push_back(entry);
+        }
+        size_t itemQty = menu->size(), ingredientQty = loaded.ingredientNames.size();
+        loaded.rowStart.assign(itemQty + 1, 0);
+        for (const Entry& entry : merged) {
+            ++loaded.rowStart[entry.item + 1];
+            loaded.rowIngredient.push_back(entry.ingredient);
+            loaded.rowAmount.push_back(entry.amount);
+        }
+        for (size_t i = 0; i < itemQty; ++i)
+            loaded.rowStart[i + 1] += loaded.rowStart[i];
+
+        // Columns: the transpose, by ingredient, then item.
+        stable_sort(merged.begin(), merged.end(), [](const Entry& a, const Entry& b) { return a.ingredient < b.ingredient; });
+        loaded.colStart.assign(ingredientQty + 1, 0);
+        for (const Entry& entry : merged) {
+            ++loaded.colStart[entry.ingredient + 1];
+            loaded.colItem.push_back(entry.item);
+            loaded.colAmount.push_back(entry.amount);
+        }
+        for (size_t j = 0; j < ingredientQty; ++j)
+            loaded.colStart[j + 1] += loaded.colStart[j];
+
+        loaded.stockedQty.reset(new atomic<int64_t>[ingredientQty]);
+        loaded.usedQty.reset(new atomic<int64_t>[ingredientQty]);
+        for (size_t j = 0; j < ingredientQty; ++j) {
+            loaded.stockedQty[j].store(stocked[j]);
+            loaded.usedQty[j].store(0);
+        }
+        book = move(loaded);
+        return true;
+    }
+
+    size_t ingredientQty() const { return ingredientNames.size(); }
+    const string& ingredientName(uint32_t ingredient) const { return ingredientNames[ingredient]; }
+
+    int find(string_view name) const {
+        auto found = ids.find(string(name));
+        return found == ids.end() ? -1 : int(found->second);
+    }
+
+    int64_t used(uint32_t ingredient) const { return usedQty[ingredient].load(memory_order_relaxed); }
+
+    // What is left of an ingredient, never below zero, or UNCOUNTED.
+    int64_t onHand(uint32_t ingredient) const {
+        int64_t stocked = stockedQty[ingredient].load(memory_order_relaxed);
+        return stocked == UNCOUNTED ? UNCOUNTED : max<int64_t>(0, stocked - used(ingredient));
+    }
+
+    // Sets what is left now; UNCOUNTED stops counting the ingredient. It is
+    // kept as the day's stock, today's use included, so use counts down from it.
+    void setOnHand(uint32_t ingredient, int64_t amount) {
+        stockedQty[ingredient].store(amount == UNCOUNTED ? UNCOUNTED : amount + used(ingredient), memory_order_relaxed);
+    }
+
+    // Adds the items' ingredients to consumption (sign 1) or gives them back (sign -1).
+    void consume(const Entrees* items, size_t n, int sign) {
+        for (size_t i = 0; i < n; ++i)
+            consume(items[i], sign);
+    }
+
+    void consume(Entrees item, int sign) {
+        if (size_t(item) + 1 >= rowStart.size()) return; // no recipes, or NO_ITEM
+        for (uint32_t k = rowStart[item]; k < rowStart[item + 1]; ++k)
+            usedQty[rowIngredient[k]].fetch_add(int64_t(rowAmount[k]) * sign, memory_order_relaxed);
+    }
+
+    // How many more portions of an item the counted ingredients allow, or
+    // UNCOUNTED if none of its ingredients are counted.
+    int64_t portionsLeft(Entrees item) const {
+        int64_t portions = UNCOUNTED;
+        if (size_t(item) + 1 >= rowStart.size()) return portions;
+        for (uint32_t k = rowStart[item]; k < rowStart[item + 1]; ++k) {
+            int64_t have = onHand(rowIngredient[k]);
+            if (have == UNCOUNTED) continue;
+            int64_t enough = have / rowAmount[k];
+            portions = portions == UNCOUNTED ? enough : min(portions, enough);
+        }
+        return portions;
+    }
+
+    // usage[j] = how much of ingredient j itemCounts[i] portions of every item
+    // i take. itemCounts has one entry per menu position.
+    void explode(const uint32_t* itemCounts, int64_t* usage) const {
+        for (size_t j = 0; j + 1 < colStart.size(); ++j) {
+            int64_t total = 0;
+            for (uint32_t k = colStart[j]; k < colStart[j + 1]; ++k)
+                total += int64_t(colAmount[k]) * itemCounts[colItem[k]];
+            usage[j] = total;
+        }
+    }
+
+    // Replaces running consumption with the explosion of itemCounts.
+    void recount(const vector<uint32_t>& itemCounts) {
+        vector<int64_t> usage(ingredientQty());
+        explode(itemCounts.data(), usage.data());
+        for (size_t j = 0; j < usage.size(); ++j)
+            usedQty[j].store(usage[j], memory_order_relaxed);
+    }
+
+private:
+    uint32_t intern(string_view name) {
+        auto [slot, added] = ids.try_emplace(string(name), uint32_t(ingredientNames.size()));
+        if (added) ingredientNames.emplace_back(name);
+        return slot->second;
+    }
+
+    vector<uint32_t> rowStart;      // per item, into rowIngredient/rowAmount
+    vector<uint32_t> rowIngredient;
+    vector<int32_t> rowAmount;
+    vector<uint32_t> colStart;      // per ingredient, into colItem/colAmount
+    vector<uint32_t> colItem;
+    vector<int32_t> colAmount;
+    vector<string> ingredientNames;
+    unordered_map<string, uint32_t> ids;
+    unique_ptr<atomic<int64_t>[]> stockedQty; // left is stockedQty - usedQty
+    unique_ptr<atomic<int64_t>[]> usedQty;
+};
+
+RecipeBook recipes;
+
+struct Table {
+    uint8_t capacity = TABLE_CAPACITY;
+    uint8_t seatedGuests = 0;
+};
+static_assert(TABLE_CAPACITY <= numeric_limits<uint8_t>::max(), "seat counts are stored in a byte");
+
+enum class OrderStatus { NONE, AWAITING_COMPLETION, AWAITING_PAYMENT, ALL_DONE };
+
+// Memory for one service day's order data. Allocation bumps a pointer in
+// large blocks; nothing is freed piecemeal, and release() hands back the
+// whole day at once. Terminals on different tables may allocate at the same
+// time, so allocation takes a lock, but only tabs outgrowing their inline
+// storage allocate at all.
+class DayArena : public pmr::memory_resource {
+public:
+    void release() {
+        lock_guard<mutex> guard(lock);
+        arena.release();
+    }
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        lock_guard<mutex> guard(lock);
+        return arena.allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void*, size_t, size_t) override {}
+
+    bool do_is_equal(const pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    mutex lock;
+    pmr::monotonic_buffer_resource arena{DAY_ARENA_BLOCK_BYTES};
+};
+
+// A tab in 24 bytes. Item codes are packed ITEM_BITS apiece into 64-bit
+// words, and the first word is stored inline, so an order of up to
+// ITEMS_PER_WORD items (a full table and then some) needs no allocation.
+// Longer tabs move to an array in the day's arena that doubles as it fills;
+// the arena owns that storage, so an Order is a plain value. The lifecycle
+// state is a 2-bit OrderStatus beside the item count, and the tab records
+// which menu version it is priced against, so its receipt matches its bill
+// however the menu changes meanwhile.
+class Order {
+public:
+    static constexpr int ITEM_BITS = bit_width(unsigned(MAX_MENU_ITEMS - 1));
+    static constexpr uint32_t ITEMS_PER_WORD = 64 / ITEM_BITS;
+    static_assert(ITEMS_PER_WORD >= TABLE_CAPACITY, "a full table must fit inline");
+
+    // Kept up to date as items are added so billing never rescans the tab.
+    Money subtotal;
+
+    explicit Order(uint32_t menuVersion = 0)
+        : itemQty(0), state(uint32_t(OrderStatus::AWAITING_COMPLETION)), wordsLog2(0), pricedAt(menuVersion), inlineWord(0) {}
+
+    bool isCompleted() const { return state != uint32_t(OrderStatus::AWAITING_COMPLETION); }
+    bool isPaid() const { return state == uint32_t(OrderStatus::ALL_DONE); }
+    OrderStatus status() const { return OrderStatus(state); }
+    void setStatus(OrderStatus status) { state = uint32_t(status); }
+    uint32_t menuVersion() const { return pricedAt; }
+
+    size_t size() const { return itemQty; }
+
+    Entrees item(size_t i) const {
+        uint64_t word = data()[i / ITEMS_PER_WORD];
+        return Entrees((word >> (i % ITEMS_PER_WORD * ITEM_BITS)) & ((1u << ITEM_BITS) - 1));
+    }
+
+    // price comes from the menu version the tab is priced against.
+    void addItem(Entrees item, Money price, pmr::memory_resource& arena) {
+        if (itemQty == words() * ITEMS_PER_WORD) grow(arena);
+        data()[itemQty / ITEMS_PER_WORD] |= uint64_t(item) << (itemQty % ITEMS_PER_WORD * ITEM_BITS);
+        ++itemQty;
+        subtotal += price;
+    }
+
+    size_t heapBytes() const { return wordsLog2 ? words() * sizeof(uint64_t) : 0; }
+
+private:
+    uint32_t words() const { return uint32_t(1) << wordsLog2; }
+    uint64_t* data() { return wordsLog2 ? heapWords : &inlineWord; }
+    const uint64_t* data() const { return wordsLog2 ? heapWords : &inlineWord; }
+
+    // The outgrown array stays in the arena until the day is released.
+    void grow(pmr::memory_resource& arena) {
+        uint32_t wanted = words() * 2;
+        auto grown = static_cast<uint64_t*>(arena.allocate(wanted * sizeof(uint64_t), alignof(uint64_t)));
+        memcpy(grown, data(), words() * sizeof(uint64_t));
+        memset(grown + words(), 0, (wanted - words()) * sizeof(uint64_t));
+        heapWords = grown;
+        ++wordsLog2;
+    }
+
+    uint32_t itemQty : 25;
+    uint32_t state : 2;     // an OrderStatus other than NONE
+    uint32_t wordsLog2 : 5; // 0 means the inline word
+    uint32_t pricedAt;      // menu version
+    union {
+        uint64_t inlineWord;
+        uint64_t* heapWords;
+    };
+};
+static_assert(sizeof(Order) == 24, "Order is meant to stay packed");
+static_assert(is_trivially_copyable_v<Order>, "the day arena owns all order storage");
+
+// Distinct menu items with a quantity for each, sorted by item. The entries
+// sit right behind the header in one day-arena block; merging in more than
+// the block holds moves the tally to a block twice the size, and the old one
+// stays in the arena until the day is released.
+struct ItemTally {
+    struct Entry {
+        Entrees item;
+        uint32_t qty;
+    };
+
+    uint16_t size = 0;
+    uint16_t capacity = 0;
+
+    Entry* begin() { return reinterpret_cast<Entry*>(this + 1); }
+    Entry* end() { return begin() + size; }
+    const Entry* begin() const { return reinterpret_cast<const Entry*>(this + 1); }
+    const Entry* end() const { return begin() + size; }
+
+    size_t bytes() const { return sizeof(ItemTally) + capacity * sizeof(Entry); }
+
+    // Adds the sorted, distinct entries [first, last) to tally, which may be null.
+    static void merge(ItemTally*& tally, const Entry* first, const Entry* last, pmr::memory_resource& arena) {
+        const Entry* kept = tally ? tally->begin() : nullptr;
+        size_t keptQty = tally ? tally->size : 0, merged = keptQty;
+        for (const Entry* e = first; e != last; ++e)
+            merged += !binary_search(kept, kept + keptQty, *e, byItem);
+        if (!tally || merged > tally->capacity) {
+            size_t capacity = max(merged, size_t(tally ? tally->capacity * 2 : 0));
+            void* block = arena.allocate(sizeof(ItemTally) + capacity * sizeof(Entry), alignof(Entry));
+            ItemTally* grown = new (block) ItemTally;
+            grown->capacity = uint16_t(capacity);
+            grown->size = uint16_t(keptQty);
+            copy(kept, kept + keptQty, grown->begin());
+            tally = grown;
+        }
+        // Fill from the back so the kept entries are never overwritten before they move.
+        Entry* out = tally->begin() + merged;
+        const Entry* in = tally->begin() + keptQty;
+        while (last != first) {
+            if (in != tally->begin() && (in - 1)->item >= (last - 1)->item) {
+                *--out = *--in;
+                if (out->item == (last - 1)->item) out->qty += (--last)->qty;
+            } else {
+                *--out = *--last;
+            }
+        }
+        tally->size = uint16_t(merged);
+    }
+
+    static bool byItem(const Entry& a, const Entry& b) { return a.item < b.item; }
+};
+static_assert(sizeof(ItemTally) % alignof(ItemTally::Entry) == 0, "entries follow the header");
+
+// Orders live in a dense vector indexed by table number. A bitmap marks which
+// tables currently have an order on file, so lookups are a single index and
+// status scans walk contiguous memory instead of tree nodes. The store also
+// counts orders in each lifecycle state; all state changes go through it so
+// the counts stay exact. Storage for long tabs comes from the store's day
+// arena, which reset() releases along with every order. An order pins the
+// menu version it is priced against (see MenuBoard) until its table starts a
+// new tab or the day closes. Beside each slot the store keeps an ItemTally of
+// the tab's distinct items, so a receipt is read off without sorting the tab,
+// and a second one of what the table's earlier, paid tabs served today.
+// Together they are what recovery recounts ingredient use from; a voided tab
+// is in neither. Both grow with the distinct items ordered, not the menu.
+//
+// A table's slot may only be changed while holding that table's lock (see
+// OrderEngine). The bitmap words and the counters are shared between tables,
+// so they are atomics.
+class OrderStore {
+public:
+    explicit OrderStore(int tableQty) { reset(tableQty); }
+
+    void reset(int tableQty) {
+        forEach([](int, const Order& order) { menuBoard.unpin(order.menuVersion()); });
+        slots.assign(tableQty + 1, Order());
+        tabTallies.assign(tableQty + 1, nullptr);
+        earlierTallies.assign(tableQty + 1, nullptr);
+        occupied = vector<atomic<uint64_t>>(tableQty / 64 + 1);
+        for (atomic<size_t>* counter : {&count, &awaitingCompletion, &awaitingPayment, &settled})
+            counter->store(0);
+        anyOpened.store(false);
+        dayArena.release();
+    }
+
+    bool contains(int tableId) const {
+        return (occupied[tableId >> 6].load(memory_order_acquire) >> (tableId & 63)) & 1;
+    }
+
+    Order& at(int tableId) { return slots[tableId]; }
+    const Order& at(int tableId) const { return slots[tableId]; }
+
+    // Returns the open order for a table, starting an empty one priced
+    // against menuVersion if the table has none yet or its last order has
+    // been paid.
+    Order& open(int tableId, uint32_t menuVersion) {
+        uint64_t bit = uint64_t(1) << (tableId & 63);
+        if (!contains(tableId)) {
+            slots[tableId] = Order(menuVersion);
+            menuBoard.pin(menuVersion);
+            markHadOrders();
+            ++count;
+            ++awaitingCompletion;
+            occupied[tableId >> 6].fetch_or(bit, memory_order_release);
+        } else if (slots[tableId].isPaid()) {
+            // The previous party has settled up; the next one starts a new tab.
+            retireTally(tableId);
+            menuBoard.unpin(slots[tableId].menuVersion());
+            slots[tableId] = Order(menuVersion);
+            menuBoard.pin(menuVersion);
+            --settled;
+            ++awaitingCompletion;
+        }
+        return slots[tableId];
+    }
+
+    // Adds items to the table's open tab, skipping NO_ITEM. prices is the
+    // menu version the tab is priced against.
+    void addItems(int tableId, const Entrees* items, size_t n, const MenuCatalog& prices) {
+        array<ItemTally::Entry, MAX_PARTY> batch;
+        while (n > 0) {
+            size_t taken = min(n, batch.size()), distinct = 0;
+            for (size_t i = 0; i < taken; ++i) {
+                if (items[i] == NO_ITEM) continue;
+                slots[tableId].addItem(items[i], prices.price(items[i]), dayArena);
+                batch[distinct++] = {items[i], 1};
+            }
+            sort(batch.begin(), batch.begin() + distinct, ItemTally::byItem);
+            size_t unique = 0;
+            for (size_t i = 0; i < distinct; ++i) {
+                if (unique > 0 && batch[unique - 1].item == batch[i].item) ++batch[unique - 1].qty;
+                else batch[unique++] = batch[i];
+            }
+            if (unique > 0) ItemTally::merge(tabTallies[tableId], batch.data(), batch.data() + unique, dayArena);
+            items += taken;
+            n -= taken;
+        }
+    }
+
+    // The distinct items on the table's tab, or null if nothing has been
+    // ordered there today.
+    const ItemTally* itemCounts(int tableId) const { return tabTallies[tableId]; }
+
+    // What the table's earlier tabs served today, or null if none has been paid.
+    const ItemTally* earlierCounts(int tableId) const { return earlierTallies[tableId]; }
+
+    // Calls fn(item, qty) for what the table has served today, its open or
+    // last paid tab included.
+    template <typename Fn>
+    void forEachServed(int tableId, Fn&& fn) const {
+        for (const ItemTally* tally : {earlierTallies[tableId], tabTallies[tableId]}) {
+            for (const ItemTally::Entry* e = tally ? tally->begin() : nullptr; tally && e != tally->end(); ++e)
+                fn(e->item, e->qty);
+        }
+    }
+
+    // Recovery: sets what a table's earlier tabs served to what a snapshot
+    // recorded.
+    void restoreEarlier(int tableId, vector<ItemTally::Entry>& served) {
+        if (earlierTallies[tableId]) earlierTallies[tableId]->size = 0;
+        sort(served.begin(), served.end(), ItemTally::byItem);
+        size_t unique = 0;
+        for (size_t i = 0; i < served.size(); ++i) {
+            if (unique > 0 && served[unique - 1].item == served[i].item) served[unique - 1].qty += served[i].qty;
+            else served[unique++] = served[i];
+        }
+        if (unique > 0) ItemTally::merge(earlierTallies[tableId], served.data(), served.data() + unique, dayArena);
+    }
+
+    void markCompleted(int tableId) {
+        Order& order = slots[tableId];
+        if (order.isCompleted()) return;
+        order.setStatus(OrderStatus::AWAITING_PAYMENT);
+        --awaitingCompletion;
+        ++awaitingPayment;
+    }
+
+    // Drops a table's unpaid order as though it had never been opened.
+    void remove(int tableId) {
+        Order& order = slots[tableId];
+        if (order.isCompleted()) --awaitingPayment;
+        else --awaitingCompletion;
+        --count;
+        occupied[tableId >> 6].fetch_and(~(uint64_t(1) << (tableId & 63)), memory_order_release);
+        menuBoard.unpin(order.menuVersion());
+        if (ItemTally* tab = tabTallies[tableId]) tab->size = 0;
+        order = Order();
+    }
+
+    void markPaid(int tableId) {
+        Order& order = slots[tableId];
+        if (order.isPaid()) return;
+        order.setStatus(OrderStatus::ALL_DONE);
+        --awaitingPayment;
+        ++settled;
+    }
+
+    bool empty() const { return count == 0; }
+
+    // Whether any tab was opened today, even if it was voided since.
+    bool hadOrders() const { return anyOpened.load(memory_order_relaxed); }
+    void markHadOrders() { anyOpened.store(true, memory_order_relaxed); }
+    size_t size() const { return count; }
+
+    // Bytes held by the store: the slot array, the bitmap and every tab's heap spill.
+    size_t memoryBytes() const {
+        size_t bytes = slots.capacity() * sizeof(Order) + occupied.size() * sizeof(uint64_t)
+                     + (tabTallies.capacity() + earlierTallies.capacity()) * sizeof(ItemTally*);
+        for (const Order& order : slots)
+            bytes += order.heapBytes();
+        for (const vector<ItemTally*>* tallies : {&tabTallies, &earlierTallies}) {
+            for (const ItemTally* tally : *tallies)
+                bytes += tally ? tally->bytes() : 0;
+        }
+        return bytes;
+    }
+    bool allSettled() const { return settled == count; }
+
+    // Visits every table with an order, in ascending table order.
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        for (size_t word = 0; word < occupied.size(); ++word) {
+            for (uint64_t bits = occupied[word].load(memory_order_acquire); bits; bits &= bits - 1) {
+                int tableId = int(word * 64) + countr_zero(bits);
+                fn(tableId, slots[tableId]);
+            }
+        }
+    }
+
+private:
+    // Moves a paid tab's counts onto the table's earlier tabs, keeping the
+    // tab's block for the next party.
+    void retireTally(int tableId) {
+        ItemTally* tab = tabTallies[tableId];
+        if (!tab || tab->size == 0) return;
+        ItemTally::merge(earlierTallies[tableId], tab->begin(), tab->end(), dayArena);
+        tab->size = 0;
+    }
+
+    vector<Order> slots;
+    vector<ItemTally*> tabTallies;     // by table, in the day arena
+    vector<ItemTally*> earlierTallies; // by table, in the day arena
+    vector<atomic<uint64_t>> occupied;
+    DayArena dayArena;
+    atomic<size_t> count{0};
+    atomic<size_t> awaitingCompletion{0};
+    atomic<size_t> awaitingPayment{0};
+    atomic<size_t> settled{0};
+    atomic<bool> anyOpened{false};
+};
+
+void syncFile(FILE* file) {
+    fflush(file);
+#ifdef _WIN32
+    _commit(_fileno(file));
+#else
+    fsync(fileno(file));
+#endif
+}
+
+// Moves a fully written temporary file over path. rename() won't replace an
+// existing file on every platform, so the old file is removed first if need be.
+bool replaceFile(const string& tmpPath, const string& path) {
+    if (rename(tmpPath.c_str(), path.c_str()) == 0) return true;
+    remove(path.c_str());
+    return rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+// Issues 64-bit transaction IDs laid out as [day:16][terminal:8][sequence:40],
+// so IDs sort by day and never repeat. Issuing is a single CAS; the
+// high-water mark is persisted a block at a time, and only the caller that
+// crosses into a new block waits for the write. On restart, numbering
+// resumes past every ID that could have been handed out.
+class TransactionIdGenerator {
+public:
+    TransactionIdGenerator(int terminalId, string hwmPath)
+        : terminalBits(uint64_t(terminalId & 0xFF) << 40), hwmPath(move(hwmPath)) {
+        uint64_t persisted = 0;
+        ifstream in(this->hwmPath);
+        in >> persisted;
+        lastId.store(persisted);
+        reservedLimit.store(persisted);
+    }
+
+    uint64_t next() {
+        uint64_t dayStart = (currentDay() << 48) | terminalBits;
+        uint64_t prev = lastId.load(memory_order_relaxed);
+        uint64_t id;
+        do {
+            id = max(prev + 1, dayStart);
+        } while (!lastId.compare_exchange_weak(prev, id, memory_order_relaxed));
+
+        if (id >= reservedLimit.load(memory_order_acquire))
+            reserveThrough(id);
+        return id;
+    }
+
+private:
+    static const uint64_t RESERVE_BLOCK = 1024;
+
+    static uint64_t currentDay() {
+        using namespace chrono;
+        return uint64_t(duration_cast<hours>(system_clock::now().time_since_epoch()).count() / 24);
+    }
+
+    void reserveThrough(uint64_t id) {
+        lock_guard<mutex> guard(reserveLock);
+        if (id < reservedLimit.load(memory_order_relaxed))
+            return;
+
+        uint64_t limit = id + RESERVE_BLOCK;
+        string tmpPath = hwmPath + ".tmp";
+        if (FILE* out = fopen(tmpPath.c_str(), "w")) {
+            fprintf(out, "%llu\n", static_cast<unsigned long long>(limit));
+            syncFile(out);
+            fclose(out);
+            replaceFile(tmpPath, hwmPath);
+        }
+        reservedLimit.store(limit, memory_order_release);
+    }
+
+    const uint64_t terminalBits;
+    const string hwmPath;
+    atomic<uint64_t> lastId{0};
+    atomic<uint64_t> reservedLimit{0};
+    mutex reserveLock;
+};
+
+// Bounded lock-free multi-producer/multi-consumer queue (Vyukov's design).
+// Each cell carries a sequence number that tells producers and consumers
+// whether it is free to write or ready to read, so neither side takes a lock.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : mask(capacity - 1), cells(new Cell[capacity]) {
+        // capacity must be a power of two
+        for (size_t i = 0; i < capacity; ++i)
+            cells[i].sequence.store(i, memory_order_relaxed);
+    }
+
+    bool tryPush(T&& value) {
+        size_t pos = tail.load(memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.sequence.load(memory_order_acquire);
+            intptr_t diff = intptr_t(seq) - intptr_t(pos);
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    cell.value = move(value);
+                    cell.sequence.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = tail.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T& value) {
+        size_t pos = head.load(memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.sequence.load(memory_order_acquire);
+            intptr_t diff = intptr_t(seq) - intptr_t(pos + 1);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    value = move(cell.value);
+                    cell.sequence.store(pos + mask + 1, memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // empty
+            } else {
+                pos = head.load(memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Cell {
+        atomic<size_t> sequence;
+        T value;
+    };
+
+    const size_t mask;
+    unique_ptr<Cell[]> cells;
+    alignas(64) atomic<size_t> tail{0};
+    alignas(64) atomic<size_t> head{0};
+};
+
+struct ReceiptLine {
+    uint32_t sku;
+    uint32_t qty;
+    Money amount;
+};
+
+// Everything needed to reproduce a receipt, independent of how it is stored.
+struct ReceiptRecord {
+    uint64_t transId = 0;
+    uint32_t tableId = 0;
+    Money subtotal, tax, tip, total;
+    vector<ReceiptLine> lines;
+};
+
+template <typename Out>
+void renderReceipt(Out& out, const ReceiptRecord& receipt) {
+    out << "*** RECEIPT FOR TABLE " << receipt.tableId << " ***\n";
+    out << "-------------------------\n";
+    MenuView menu;
+    for (const ReceiptLine& line : receipt.lines) {
+        Entrees item = menu->find(line.sku);
+        if (item != NO_ITEM) out << menu->name(item); else out << "Item #" << line.sku;
+        if (line.qty > 1) out << " x" << line.qty;
+        out << " - $" << line.amount << "\n";
+    }
+    out << "-------------------------\n";
+    out << "Subtotal: $" << receipt.subtotal << "\n";
+    out << "Tip (20%): $" << receipt.tip << "\n";
+    out << "Tax (10%): $" << receipt.tax << "\n";
+    out << "Total: $" << receipt.total << "\n";
+}
+
+// Append-only receipt storage. Records are length-prefixed binary blobs
+// written to numbered segment files (receipts.000001.log, ...). A separate
+// index of fixed-size {transId, segment, offset} entries stays sorted because
+// transaction IDs only increase and receipts are appended in the order their
+// IDs were issued (see OrderEngine::pay), so a receipt is found by binary
+// search.
+// Records use host byte order; the journal is read back on the machine that
+// wrote it.
+class ReceiptJournal {
+public:
+    explicit ReceiptJournal(string prefix) : prefix(move(prefix)) {
+        while (fileSize(segmentPath(segment + 1)) >= 0)
+            ++segment;
+        if (segment == 0) segment = 1;
+        offset = max(fileSize(segmentPath(segment)), 0L);
+        indexPath = this->prefix + ".idx";
+    }
+
+    ~ReceiptJournal() {
+        if (segmentFile) fclose(segmentFile);
+        if (indexFile) fclose(indexFile);
+    }
+
+    void append(const ReceiptRecord& receipt) {
+        encode(receipt, scratch);
+        uint32_t length = uint32_t(scratch.size());
+        if (offset > 0 && offset + long(sizeof(length) + length) > RECEIPT_SEGMENT_BYTES) {
+            if (segmentFile) fclose(segmentFile);
+            segmentFile = nullptr;
+            ++segment;
+            offset = 0;
+        }
+        if (!segmentFile) segmentFile = fopen(segmentPath(segment).c_str(), "ab");
+        if (!indexFile) indexFile = fopen(indexPath.c_str(), "ab");
+        if (!segmentFile || !indexFile) {
+            cerr << "Could not write receipt #" << receipt.transId << " to the receipt journal.\n";
+            return;
+        }
+
+        fwrite(&length, sizeof(length), 1, segmentFile);
+        fwrite(scratch.data(), 1, length, segmentFile);
+
+        IndexEntry entry = {receipt.transId, segment, uint32_t(offset)};
+        fwrite(&entry, sizeof(entry), 1, indexFile);
+        offset += long(sizeof(length) + length);
+    }
+
+    // Hands buffered records to the OS, and with durable=true forces them to
+    // stable storage. The segment is synced before the index so an index
+    // entry never points past the end of its segment.
+    void flush(bool durable) {
+        for (FILE* f : {segmentFile, indexFile}) {
+            if (!f) continue;
+            if (durable) syncFile(f); else fflush(f);
+        }
+    }
+
+    bool find(uint64_t transId, ReceiptRecord& receipt) const {
+        FILE* index = fopen(indexPath.c_str(), "rb");
+        if (!index) return false;
+        fseek(index, 0, SEEK_END);
+        long lo = 0, hi = ftell(index) / long(sizeof(IndexEntry));
+        IndexEntry entry{};
+        bool found = false;
+        while (lo < hi) {
+            long mid = lo + (hi - lo) / 2;
+            fseek(index, mid * long(sizeof(IndexEntry)), SEEK_SET);
+            if (fread(&entry, sizeof(entry), 1, index) != 1) break;
+            if (entry.transId == transId) { found = true; break; }
+            if (entry.transId < transId) lo = mid + 1; else hi = mid;
+        }
+        fclose(index);
+        if (!found) return false;
+
+        FILE* seg = fopen(segmentPath(entry.segment).c_str(), "rb");
+        if (!seg) return false;
+        uint32_t length = 0;
+        string payload;
+        fseek(seg, long(entry.offset), SEEK_SET);
+        bool ok = fread(&length, sizeof(length), 1, seg) == 1;
+        if (ok) {
+            payload.resize(length);
+            ok = fread(&payload[0], 1, length, seg) == length;
+        }
+        fclose(seg);
+        return ok && decode(payload, receipt);
+    }
+
+private:
+    struct IndexEntry {
+        uint64_t transId;
+        uint32_t segment;
+        uint32_t offset;
+    };
+
+    static long fileSize(const string& path) {
+        FILE* f = fopen(path.c_str(), "rb");
+        if (!f) return -1;
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        fclose(f);
+        return size;
+    }
+
+    string segmentPath(uint32_t n) const {
+        char name[16];
+        snprintf(name, sizeof(name), ".%06u.log", n);
+        return prefix + name;
+    }
+
+    template <typename T>
+    static void put(string& buf, T value) {
+        buf.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    static bool get(const string& buf, size_t& pos, T& value) {
+        if (pos + sizeof(value) > buf.size()) return false;
+        memcpy(&value, buf.data() + pos, sizeof(value));
+        pos += sizeof(value);
+        return true;
+    }
+
+    static void encode(const ReceiptRecord& receipt, string& buf) {
+        buf.clear();
+        put(buf, receipt.transId);
+        put(buf, receipt.tableId);
+        put(buf, receipt.subtotal.cents);
+        put(buf, receipt.tax.cents);
+        put(buf, receipt.tip.cents);
+        put(buf, receipt.total.cents);
+        put(buf, uint16_t(receipt.lines.size()));
+        for (const ReceiptLine& line : receipt.lines) {
+            put(buf, line.sku);
+            put(buf, line.qty);
+            put(buf, line.amount.cents);
+        }
+    }
+
+    static bool decode(const string& buf, ReceiptRecord& receipt) {
+        size_t pos = 0;
+        uint16_t lineCount = 0;
+        bool ok = get(buf, pos, receipt.transId) && get(buf, pos, receipt.tableId)
+               && get(buf, pos, receipt.subtotal.cents) && get(buf, pos, receipt.tax.cents)
+               && get(buf, pos, receipt.tip.cents) && get(buf, pos, receipt.total.cents)
+               && get(buf, pos, lineCount);
+        receipt.lines.resize(lineCount);
+        for (ReceiptLine& line : receipt.lines) {
+            ok = ok && get(buf, pos, line.sku) && get(buf, pos, line.qty) && get(buf, pos, line.amount.cents);
+        }
+        return ok;
+    }
+
+    const string prefix;
+    string indexPath;
+    uint32_t segment = 0;
+    long offset = 0;
+    FILE* segmentFile = nullptr;
+    FILE* indexFile = nullptr;
+    string scratch;
+};
+
+enum class Durability { FIRE_AND_FORGET, GROUP_COMMIT };
+
+// Persists receipts on a background thread so confirming a payment only costs
+// a queue push. In GROUP_COMMIT mode, everything written since the last sync
+// is fsynced together once per commit interval.
+class ReceiptWriter {
+public:
+    ReceiptWriter(ReceiptJournal* journal, Durability durability, chrono::milliseconds commitInterval)
+        : journal(journal), durability(durability), commitInterval(commitInterval),
+          queue(RECEIPT_QUEUE_CAPACITY), worker([this] { run(); }) {}
+
+    ~ReceiptWriter() { drain(); }
+
+    void submit(ReceiptRecord&& receipt) {
+        while (!queue.tryPush(move(receipt))) {
+            wakeup.notify_one();
+            this_thread::yield();
+        }
+        wakeup.notify_one();
+    }
+
+    // Writes out everything still queued and stops the writer thread.
+    void drain() {
+        if (!worker.joinable()) return;
+        stopping.store(true, memory_order_release);
+        wakeup.notify_one();
+        worker.join();
+    }
+
+private:
+    void run() {
+        auto lastCommit = chrono::steady_clock::now();
+        ReceiptRecord receipt;
+        for (;;) {
+            bool stop = stopping.load(memory_order_acquire);
+            bool wrote = false;
+            while (queue.tryPop(receipt)) {
+                write(receipt);
+                wrote = true;
+            }
+
+            bool group = durability == Durability::GROUP_COMMIT;
+            auto now = chrono::steady_clock::now();
+            if (wrote && !group) {
+                commit(false);
+            } else if (group && (stop || now - lastCommit >= commitInterval)) {
+                commit(true);
+                lastCommit = now;
+            }
+            if (stop) return;
+
+            unique_lock<mutex> lock(sleepLock);
+            wakeup.wait_for(lock, group ? commitInterval : chrono::milliseconds(10));
+        }
+    }
+
+    void write(const ReceiptRecord& receipt) {
+        if (journal) {
+            journal->append(receipt);
+            return;
+        }
+        string filename = "Transaction#" + to_string(receipt.transId) + ".txt";
+        FILE* file = fopen(filename.c_str(), "wb");
+        if (!file) {
+            cerr << "Could not write receipt '" << filename << "'.\n";
+            return;
+        }
+        text.clear();
+        renderReceipt(text, receipt);
+        fwrite(text.str().data(), 1, text.size(), file);
+        if (durability != Durability::GROUP_COMMIT) {
+            fclose(file);
+            return;
+        }
+        // Sync early rather than run out of file descriptors in a busy window.
+        unsynced.push_back(file);
+        if (unsynced.size() == RECEIPT_FILES_OPEN) syncFiles();
+    }
+
+    void commit(bool durable) {
+        if (journal) journal->flush(durable);
+        syncFiles();
+    }
+
+    void syncFiles() {
+        for (FILE* file : unsynced) {
+            syncFile(file);
+            fclose(file);
+        }
+        unsynced.clear();
+    }
+
+    ReceiptJournal* const journal;
+    const Durability durability;
+    const chrono::milliseconds commitInterval;
+    BoundedQueue<ReceiptRecord> queue;
+    vector<FILE*> unsynced;
+    TextBuffer text;
+    atomic<bool> stopping{false};
+    mutex sleepLock;
+    condition_variable wakeup;
+    thread worker;
+};
+
+int tableQty = TABLE_QTY;
+vector<Table> tables;         // indexed by table number; slot 0 unused
+OrderStore orders(TABLE_QTY);
+TransactionIdGenerator transactionIds(TERMINAL_ID, TRANSACTION_HWM_FILE);
+unique_ptr<ReceiptJournal> receiptJournal; // null = one .txt file per receipt
+unique_ptr<ReceiptWriter> receiptWriter;
+
+bool allOrdersPaidAndComplete() {
+    return orders.allSettled();
+}
+
+// Outcome of a business operation.
+enum class OpResult { OK, NO_SUCH_TABLE, TABLE_FULL, INVALID_ITEM, NO_ORDER, NOT_COMPLETED, ORDERS_PENDING,
+                      ITEM_UNAVAILABLE, MENU_BUSY, OUT_OF_STOCK, NO_SUCH_INGREDIENT, NO_SUCH_STATION,
+                      NO_TICKET, ALREADY_PAID };
+
+const char* describe(OpResult result) {
+    switch (result) {
+        case OpResult::OK:                 return "ok";
+        case OpResult::NO_SUCH_TABLE:      return "no such table";
+        case OpResult::TABLE_FULL:         return "not enough free seats";
+        case OpResult::INVALID_ITEM:       return "invalid item number";
+        case OpResult::NO_ORDER:           return "no order found";
+        case OpResult::NOT_COMPLETED:      return "order is not completed yet";
+        case OpResult::ORDERS_PENDING:     return "orders still pending";
+        case OpResult::ITEM_UNAVAILABLE:   return "item is not available";
+        case OpResult::MENU_BUSY:          return "too many menu versions still in use";
+        case OpResult::OUT_OF_STOCK:       return "item is sold out";
+        case OpResult::NO_SUCH_INGREDIENT: return "no such ingredient";
+        case OpResult::NO_SUCH_STATION:    return "no such kitchen station";
+        case OpResult::NO_TICKET:          return "no tickets waiting";
+        case OpResult::ALREADY_PAID:       return "order is already paid";
+    }
+    return "unknown error";
+}
+
+struct Bill {
+    Money subtotal, tax, tip, total;
+};
+
+Bill billFor(const Order& order) {
+    Bill bill;
+    bill.subtotal = order.subtotal;
+    bill.tax = bill.subtotal.applied(TAX_RATE);
+    bill.tip = bill.subtotal.applied(TIP_RATE);
+    bill.total = bill.subtotal + bill.tax + bill.tip;
+    return bill;
+}
+
+enum class WalType : uint8_t { PLACE = 1, COMPLETE = 2, PAY = 3, VOID = 4, MENU = 5 };
+
+// One logged state transition. Fixed size, with a checksum over the other
+// fields so a torn write at the end of the log is recognised on recovery.
+// A PLACE record names the menu version its tab is priced against. A MENU
+// record logs one item's change instead of an order: skus[0] is the item,
+// skus[2..3] hold its new price in cents, guests is 1 if it is on the menu,
+// and menuVersion is the number of the version the change published.
+struct WalRecord {
+    uint32_t skus[TABLE_CAPACITY]; // items by SKU, so a reordered menu file replays correctly
+    uint32_t tableId;
+    uint32_t menuVersion;
+    WalType type;
+    uint8_t guests;
+    uint16_t check;
+
+    uint16_t checksum() const {
+        // Fletcher-16 over everything before the checksum itself.
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(this);
+        uint32_t a = 0, b = 0;
+        for (size_t i = 0; i < offsetof(WalRecord, check); ++i) {
+            a = (a + bytes[i]) % 255;
+            b = (b + a) % 255;
+        }
+        return uint16_t(b << 8 | a);
+    }
+};
+static_assert(sizeof(WalRecord) == 28, "WAL records are written as raw 28-byte blocks");
+
+// Append-only write-ahead log of table and order transitions, kept as
+// numbered segment files (<path>.000001, ...). Each segment starts with the
+// log sequence number (LSN) of the record before its first one, so every
+// record's LSN is implicit in its position. append() only copies a record
+// into a shared buffer and returns its LSN; commit() returns once everything
+// up to that LSN has been written. The first caller to commit while no write
+// is running writes out everything buffered so far on behalf of every waiter
+// (group commit), so concurrent terminals share one write, and with
+// fsyncOnCommit one fsync. Without fsync, a committed record survives the
+// process dying but not the machine.
+class WriteAheadLog {
+public:
+    WriteAheadLog(string path, bool fsyncOnCommit) : path(move(path)), fsyncOnCommit(fsyncOnCommit) {}
+
+    ~WriteAheadLog() {
+        if (file) fclose(file);
+    }
+
+    const string& basePath() const { return path; }
+    uint64_t lastLsn() {
+        lock_guard<mutex> guard(lock);
+        return appended;
+    }
+
+    // Feeds every intact record to apply(record, lsn), cuts off a torn tail,
+    // and opens the newest segment for appending. Returns the number of
+    // records apply() accepted.
+    template <typename Fn>
+    size_t recover(Fn&& apply) {
+        size_t replayed = 0;
+        vector<uint32_t> numbers = segmentNumbers();
+        vector<WalRecord> chunk(1 << 16);
+        for (uint32_t number : numbers) {
+            string segPath = segmentPath(number);
+            FILE* in = fopen(segPath.c_str(), "rb");
+            uint64_t base = 0;
+            if (!in) continue;
+            if (fread(&base, sizeof(base), 1, in) != 1) {
+                fclose(in);
+                break;
+            }
+            uint64_t lsn = base;
+            bool intact = true;
+            size_t n;
+            while (intact && (n = fread(chunk.data(), sizeof(WalRecord), chunk.size(), in)) > 0) {
+                for (size_t i = 0; i < n; ++i) {
+                    if (chunk[i].check != chunk[i].checksum()) {
+                        intact = false;
+                        break;
+                    }
+                    if (apply(chunk[i], ++lsn)) ++replayed;
+                }
+            }
+            fclose(in);
+            uintmax_t validBytes = sizeof(base) + (lsn - base) * sizeof(WalRecord);
+            error_code ec;
+            if (filesystem::file_size(segPath, ec) != validBytes && !ec)
+                filesystem::resize_file(segPath, validBytes, ec);
+            appended = durable = lsn;
+            segment = number;
+        }
+
+        if (segment == 0) startSegment(1);
+        else file = fopen(segmentPath(segment).c_str(), "ab");
+        return replayed;
+    }
+
+    uint64_t append(WalRecord record) {
+        record.check = record.checksum();
+        lock_guard<mutex> guard(lock);
+        pending.push_back(record);
+        return ++appended;
+    }
+
+    void commit(uint64_t lsn) {
+        unique_lock<mutex> guard(lock);
+        while (durable < lsn) {
+            if (flushing) {
+                flushed.wait(guard);
+                continue;
+            }
+            flushing = true;
+            vector<WalRecord> batch;
+            batch.swap(pending);
+            uint64_t upTo = appended;
+            guard.unlock();
+
+            write(batch);
+
+            guard.lock();
+            if (pending.empty()) {
+                batch.clear();
+                pending.swap(batch); // keep the grown buffer
+            }
+            durable = upTo;
+            flushing = false;
+            flushed.notify_all();
+        }
+    }
+
+    // Closes the current segment and starts a new one. Returns the new
+    // segment's number; every record in earlier segments has an LSN at or
+    // below the returned boundary.
+    uint32_t rotate(uint64_t& boundary) {
+        unique_lock<mutex> guard(lock);
+        flushed.wait(guard, [this] { return !flushing; });
+        write(pending);
+        pending.clear();
+        durable = appended;
+        boundary = appended;
+        startSegment(segment + 1);
+        return segment;
+    }
+
+    // Deletes segments older than the given one, once a snapshot covers them.
+    void dropSegmentsBefore(uint32_t number) {
+        for (uint32_t old : segmentNumbers()) {
+            if (old < number) remove(segmentPath(old).c_str());
+        }
+    }
+
+    // Empties the log, e.g. once the day is closed and nothing is left to recover.
+    void reset() {
+        lock_guard<mutex> guard(lock);
+        pending.clear();
+        durable = appended;
+        uint32_t next = segment + 1;
+        if (file) fclose(file);
+        file = nullptr;
+        for (uint32_t old : segmentNumbers())
+            remove(segmentPath(old).c_str());
+        remove((path + ".snap").c_str());
+        startSegment(next);
+    }
+
+private:
+    string segmentPath(uint32_t number) const {
+        char suffix[16];
+        snprintf(suffix, sizeof(suffix), ".%06u", number);
+        return path + suffix;
+    }
+
+    vector<uint32_t> segmentNumbers() const {
+        vector<uint32_t> numbers;
+        filesystem::path full(path);
+        filesystem::path dir = full.has_parent_path() ? full.parent_path() : filesystem::path(".");
+        string prefix = full.filename().string() + ".";
+        error_code ec;
+        for (const auto& entry : filesystem::directory_iterator(dir, ec)) {
+            string name = entry.path().filename().string();
+            if (name.size() != prefix.size() + 6 || name.compare(0, prefix.size(), prefix) != 0) continue;
+            uint32_t number = 0;
+            auto parsed = from_chars(name.data() + prefix.size(), name.data() + name.size(), number);
+            if (parsed.ec == errc() && parsed.ptr == name.data() + name.size()) numbers.push_back(number);
+        }
+        sort(numbers.begin(), numbers.end());
+        return numbers;
+    }
+
+    // Called with the lock held (or before the log is shared).
+    void startSegment(uint32_t number) {
+        if (file) fclose(file);
+        segment = number;
+        file = fopen(segmentPath(number).c_str(), "wb");
+        if (file) {
+            fwrite(&appended, sizeof(appended), 1, file);
+            fflush(file);
+        }
+    }
+
+    void write(const vector<WalRecord>& batch) {
+        if (!file || batch.empty()) return;
+        fwrite(batch.data(), sizeof(WalRecord), batch.size(), file);
+        if (fsyncOnCommit) syncFile(file); else fflush(file);
+    }
+
+    const string path;
+    const bool fsyncOnCommit;
+    FILE* file = nullptr;
+    uint32_t segment = 0;
+    mutex lock;
+    condition_variable flushed;
+    vector<WalRecord> pending;
+    uint64_t appended = 0;
+    uint64_t durable = 0;
+    bool flushing = false;
+};
+
+enum class SeatingPolicy { BEST_FIT, LEAST_RECENTLY_TURNED };
+
+SeatingPolicy seatingPolicy = SeatingPolicy::BEST_FIT;
+
+// Tables bucketed by free seats. Each bucket is an intrusive doubly linked
+// list kept in the order tables entered it, so its head is the table whose
+// seating changed longest ago. Finding a table for a party looks at no more
+// than TABLE_CAPACITY bucket heads, however large the floor.
+//   BEST_FIT               the table with the fewest free seats that still
+//                          fits the party, keeping big tables for big parties
+//   LEAST_RECENTLY_TURNED  whichever fitting table has sat unchanged the
+//                          longest, spreading parties across the floor
+// Table operations call update() under their own table's lock, so it takes
+// no lock: it stamps the table's new count in one atomic word and, unless
+// the table is already waiting, pushes it on a lock-free stack. Lookups take
+// the index's lock and first drain the stack, moving tables between buckets
+// in stamp order, which is the order the changes were made.
+class SeatIndex {
+public:
+    void reset(int tableQty) {
+        lock_guard<mutex> guard(lock);
+        nodes.assign(tableQty + 1, Node());
+        pending = vector<Pending>(tableQty + 1);
+        changed.store(0);
+        head.fill(0);
+        tail.fill(0);
+        clock.store(0);
+        for (int tableId = 1; tableId <= tableQty; ++tableId) {
+            uint64_t stamp = ++clock;
+            pending[tableId].state.store(stamp << 8 | TABLE_CAPACITY, memory_order_relaxed);
+            append(tableId, TABLE_CAPACITY, stamp);
+        }
+    }
+
+    // The caller holds the table's lock.
+    void update(int tableId, int freeSeats) {
+        Pending& entry = pending[tableId];
+        if (int(entry.state.load(memory_order_relaxed) & 0xFF) == freeSeats) return;
+        uint64_t stamp = clock.fetch_add(1, memory_order_relaxed) + 1;
+        entry.state.store(stamp << 8 | uint64_t(freeSeats), memory_order_relaxed);
+        if (entry.queued.exchange(true, memory_order_acq_rel)) return;
+        entry.next = changed.load(memory_order_relaxed);
+        while (!changed.compare_exchange_weak(entry.next, tableId, memory_order_release, memory_order_relaxed)) {
+        }
+    }
+
+    // Returns a table with room for the party, or 0 if there is none.
+    int find(int guests, SeatingPolicy policy) {
+        if (guests < 1 || guests > TABLE_CAPACITY) return 0;
+        lock_guard<mutex> guard(lock);
+        drain();
+        int best = 0;
+        for (int seats = guests; seats <= TABLE_CAPACITY; ++seats) {
+            int candidate = head[seats];
+            if (!candidate) continue;
+            if (policy == SeatingPolicy::BEST_FIT) return candidate;
+            if (!best || nodes[candidate].stamp < nodes[best].stamp) best = candidate;
+        }
+        return best;
+    }
+
+    // Copies every table's free-seat count, indexed by table number.
+    void freeSeats(vector<uint8_t>& out) {
+        lock_guard<mutex> guard(lock);
+        drain();
+        out.resize(nodes.size());
+        for (size_t tableId = 1; tableId < nodes.size(); ++tableId)
+            out[tableId] = uint8_t(nodes[tableId].bucket);
+    }
+
+private:
+    struct Node {
+        int prev = 0, next = 0; // 0 ends the list; table numbers start at 1
+        int bucket = -1;
+        uint64_t stamp = 0;
+    };
+
+    struct Pending {
+        atomic<uint64_t> state{0}; // stamp << 8 | free seats
+        atomic<bool> queued{false};
+        int next = 0; // the table queued before this one
+    };
+
+    // The caller holds the lock. A table's next link is read before its flag
+    // is cleared, since clearing it lets update() queue the table again.
+    void drain() {
+        drained.clear();
+        for (int tableId = changed.exchange(0, memory_order_acquire); tableId;) {
+            Pending& entry = pending[tableId];
+            int next = entry.next;
+            entry.queued.exchange(false, memory_order_acq_rel);
+            drained.push_back({entry.state.load(memory_order_relaxed), tableId});
+            tableId = next;
+        }
+        sort(drained.begin(), drained.end());
+        for (auto [state, tableId] : drained) {
+            if (nodes[tableId].stamp == state >> 8) continue;
+            unlink(tableId);
+            append(tableId, int(state & 0xFF), state >> 8);
+        }
+    }
+
+    void append(int tableId, int freeSeats, uint64_t stamp) {
+        Node& node = nodes[tableId];
+        node.bucket = freeSeats;
+        node.stamp = stamp;
+        node.prev = tail[freeSeats];
+        node.next = 0;
+        if (node.prev) nodes[node.prev].next = tableId; else head[freeSeats] = tableId;
+        tail[freeSeats] = tableId;
+    }
+
+    void unlink(int tableId) {
+        Node& node = nodes[tableId];
+        if (node.prev) nodes[node.prev].next = node.next; else head[node.bucket] = node.next;
+        if (node.next) nodes[node.next].prev = node.prev; else tail[node.bucket] = node.prev;
+    }
+
+    mutex lock;
+    vector<Node> nodes;
+    vector<Pending> pending;
+    vector<pair<uint64_t, int>> drained;
+    atomic<int> changed{0}; // top of the stack of queued tables
+    array<int, TABLE_CAPACITY + 1> head{}, tail{};
+    atomic<uint64_t> clock{0};
+};
+
+// Which tables can be pushed together, as an undirected graph in compressed
+// adjacency form: the neighbours of table t are neighbors[offsets[t] ..
+// offsets[t + 1]). Without a floor-plan file, table t adjoins t - 1 and t + 1.
+class FloorPlan {
+public:
+    static FloorPlan linear(int tableQty) {
+        vector<pair<int, int>> edges;
+        for (int tableId = 1; tableId < tableQty; ++tableId)
+            edges.push_back({tableId, tableId + 1});
+        return FloorPlan(tableQty, edges);
+    }
+
+    // Reads "<table> <table>" pairs, one adjacency per line; '#' starts a comment.
+    static bool load(const string& path, int tableQty, FloorPlan& plan) {
+        ifstream in(path);
+        if (!in) return false;
+        vector<pair<int, int>> edges;
+        string line;
+        while (getline(in, line)) {
+            line = line.substr(0, line.find('#'));
+            int a = 0, b = 0;
+            char extra;
+            int fields = sscanf(line.c_str(), "%d %d %c", &a, &b, &extra);
+            if (fields == EOF) continue;
+            if (fields != 2 || a < 1 || b < 1 || a > tableQty || b > tableQty || a == b) return false;
+            edges.push_back({a, b});
+        }
+        plan = FloorPlan(tableQty, edges);
+        return true;
+    }
+
+    FloorPlan() = default;
+
+    bool empty() const { return offsets.empty(); }
+
+    // Picks connected tables whose free seats add up to at least the party
+    // size, wasting as few seats as possible and then using as few tables as
+    // possible. Exact packing is NP-hard, so this grows a group from every
+    // table in turn: each step adds the neighbouring table that best fits the
+    // guests still standing (the smallest one that seats them all, otherwise
+    // the largest), and the best group found wins, stopping early at a group
+    // with no empty seats and the fewest tables possible. That is
+    // O(tables * group size^2 * degree): about 10 us on a 500-table grid,
+    // about 110 us when no perfect group exists. Tables come back in the
+    // order they joined, so seating guests in that order gives every table
+    // at least one. Empty if no group fits.
+    vector<int> pack(const vector<uint8_t>& freeSeats, int guests) const {
+        int lastTable = int(offsets.size()) - 2;
+        vector<int> best, group;
+        vector<char> inGroup(lastTable + 1, 0);
+        int bestWaste = numeric_limits<int>::max();
+        int fewestTables = (guests + TABLE_CAPACITY - 1) / TABLE_CAPACITY;
+        for (int seed = 1; seed <= lastTable; ++seed) {
+            if (!freeSeats[seed]) continue;
+            group.assign(1, seed);
+            inGroup[seed] = 1;
+            int seated = freeSeats[seed];
+            while (seated < guests) {
+                int standing = guests - seated, pick = 0;
+                for (int member : group) {
+                    for (int i = offsets[member]; i < offsets[member + 1]; ++i) {
+                        int next = neighbors[i];
+                        int seats = freeSeats[next];
+                        if (inGroup[next] || !seats) continue;
+                        int current = pick ? freeSeats[pick] : 0;
+                        bool fits = seats >= standing, currentFits = current >= standing;
+                        if (!pick || (fits && (!currentFits || seats < current)) || (!fits && !currentFits && seats > current))
+                            pick = next;
+                    }
+                }
+                if (!pick) break;
+                group.push_back(pick);
+                inGroup[pick] = 1;
+                seated += freeSeats[pick];
+            }
+            for (int member : group)
+                inGroup[member] = 0;
+            int waste = seated - guests;
+            if (waste >= 0 && (waste < bestWaste || (waste == bestWaste && group.size() < best.size()))) {
+                best = group;
+                bestWaste = waste;
+                if (waste == 0 && int(best.size()) == fewestTables) break; // cannot do better
+            }
+        }
+        return best;
+    }
+
+private:
+    FloorPlan(int tableQty, const vector<pair<int, int>>& edges) : offsets(tableQty + 2, 0) {
+        for (const auto& [a, b] : edges) {
+            ++offsets[a + 1];
+            ++offsets[b + 1];
+        }
+        for (int tableId = 1; tableId <= tableQty + 1; ++tableId)
+            offsets[tableId] += offsets[tableId - 1];
+        neighbors.resize(edges.size() * 2);
+        vector<int> fill(offsets.begin(), offsets.end() - 1);
+        for (const auto& [a, b] : edges) {
+            neighbors[fill[a]++] = b;
+            neighbors[fill[b]++] = a;
+        }
+    }
+
+    vector<int> offsets;
+    vector<int> neighbors;
+};
+
+FloorPlan floorPlan;
+
+enum class KitchenPolicy { FIFO, SHORTEST_PREP_FIRST, TABLE_FIRE };
+
+KitchenPolicy kitchenPolicy = KitchenPolicy::FIFO;
+
+// One dish for a kitchen station to prepare.
+struct KitchenTicket {
+    array<uint64_t, 2> rank; // lowest goes first
+    uint32_t tableId;
+    uint32_t generation;     // the table's tab when fired
+    Entrees item;
+    uint16_t prepSeconds;
+};
+
+// Turns placed orders into tickets, one per dish, routed by item to the
+// station that prepares it. Each station keeps its tickets in a binary heap
+// ordered by a rank fixed when the ticket is fired, so firing and taking the
+// next ticket are O(log n):
+//   FIFO                 in the order tickets were fired
+//   SHORTEST_PREP_FIRST  quickest dishes first, then in order
+//   TABLE_FIRE           a table's dishes one after another, longest first,
+//                        so a table's food comes out together
+// Each table counts its outstanding tickets; when the last is done, its order
+// is complete. Paying for or voiding a tab moves the table to a new
+// generation, so leftover tickets for the old tab are dropped when they
+// reach the top of a heap. Tabs completed by hand never have theirs bumped,
+// so once stale tickets outnumber live ones, every heap is swept and rebuilt,
+// which costs O(1) amortized per ticket. A ticket only costs a heap push and
+// pop, so one lock covers the whole kitchen.
+class Kitchen {
+public:
+    static const uint16_t NO_STATION = 0xFFFF;
+
+    // Reads "<item sku>,<station>,<prep seconds>" lines; '#' starts a comment
+    // line. Items not listed (drinks, say) need no kitchen ticket.
+    static bool load(const string& path, Kitchen& kitchen, string& error) {
+        MenuView menu;
+        kitchen.routes.assign(menu->size(), {NO_STATION, 0});
+        kitchen.stations.clear();
+        return readCsv(path, error, [&](const CsvLine& line) {
+            uint32_t sku = 0;
+            uint16_t prepSeconds = 0;
+            if (line.commas != 2 || line.middle.empty() || !parseField(line.head, sku) || !parseField(line.tail, prepSeconds)) {
+                error = csvError(path, line, "expected <sku>,<station>,<prep seconds>");
+                return false;
+            }
+            Entrees item = menu->find(sku);
+            if (item == NO_ITEM) {
+                error = csvError(path, line, "no menu item " + to_string(sku));
+                return false;
+            }
+            int station = kitchen.find(line.middle);
+            if (station < 0) {
+                station = int(kitchen.stations.size());
+                kitchen.stations.emplace_back();
+                kitchen.stations.back().name = line.middle;
+            }
+            kitchen.routes[item] = {uint16_t(station), prepSeconds};
+            return true;
+        });
+    }
+
+    void reset(int tableQty) {
+        lock_guard<mutex> guard(lock);
+        tabs.assign(tableQty + 1, Tab());
+        for (Station& station : stations)
+            station.queue.clear();
+        queued = stale = 0;
+    }
+
+    int find(string_view name) const {
+        for (size_t i = 0; i < stations.size(); ++i) {
+            if (stations[i].name == name) return int(i);
+        }
+        return -1;
+    }
+
+    const string& stationName(int station) const { return stations[station].name; }
+
+    // Fires a ticket for each of the items that a station prepares.
+    void fire(int tableId, const Entrees* items, int n) {
+        if (stations.empty()) return;
+        lock_guard<mutex> guard(lock);
+        Tab& tab = tabs[tableId];
+        if (tab.outstanding == 0) tab.fireSeq = nextSeq;
+        for (int i = 0; i < n; ++i) {
+            if (items[i] == NO_ITEM || routes[items[i]].station == NO_STATION) continue;
+            Route route = routes[items[i]];
+            uint64_t seq = nextSeq++;
+            KitchenTicket ticket = {{seq, 0}, uint32_t(tableId), tab.generation, items[i], route.prepSeconds};
+            if (kitchenPolicy == KitchenPolicy::SHORTEST_PREP_FIRST)
+                ticket.rank = {route.prepSeconds, seq};
+            else if (kitchenPolicy == KitchenPolicy::TABLE_FIRE)
+                ticket.rank = {tab.fireSeq, uint64_t(UINT16_MAX - route.prepSeconds) << 48 | seq};
+            vector<KitchenTicket>& queue = stations[route.station].queue;
+            queue.push_back(ticket);
+            push_heap(queue.begin(), queue.end(), later);
+            ++tab.outstanding;
+            ++queued;
+        }
+    }
+
+    // Takes the next ticket at a station and marks it done; false if the
+    // station has nothing waiting. tabDone reports that it was the table's
+    // last outstanding ticket.
+    bool finishNext(int station, KitchenTicket& ticket, bool& tabDone) {
+        lock_guard<mutex> guard(lock);
+        vector<KitchenTicket>& queue = stations[station].queue;
+        while (!queue.empty()) {
+            pop_heap(queue.begin(), queue.end(), later);
+            ticket = queue.back();
+            queue.pop_back();
+            --queued;
+            Tab& tab = tabs[ticket.tableId];
+            if (ticket.generation != tab.generation) { // the tab was settled or voided
+                --stale;
+                continue;
+            }
+            tabDone = --tab.outstanding == 0;
+            return true;
+        }
+        return false;
+    }
+
+    // True if the tab a ticket belonged to is still open and has nothing left
+    // in the kitchen.
+    bool ready(uint32_t tableId, uint32_t generation) {
+        lock_guard<mutex> guard(lock);
+        return tabs[tableId].generation == generation && tabs[tableId].outstanding == 0;
+    }
+
+    // Drops a table's outstanding tickets once its tab is paid or voided.
+    void clear(int tableId) {
+        if (stations.empty()) return;
+        lock_guard<mutex> guard(lock);
+        ++tabs[tableId].generation;
+        stale += tabs[tableId].outstanding;
+        tabs[tableId].outstanding = 0;
+        if (stale > queued / 2 && stale >= KITCHEN_SWEEP_MIN) sweep();
+    }
+
+private:
+    struct Route {
+        uint16_t station;
+        uint16_t prepSeconds;
+    };
+
+    struct Station {
+        string name;
+        vector<KitchenTicket> queue; // a heap under later()
+    };
+
+    struct Tab {
+        uint32_t generation = 0;
+        uint32_t outstanding = 0;
+        uint64_t fireSeq = 0; // rank of the table's current round under TABLE_FIRE
+    };
+
+    static bool later(const KitchenTicket& a, const KitchenTicket& b) { return a.rank > b.rank; }
+
+    // Drops every stale ticket. The caller holds the lock.
+    void sweep() {
+        for (Station& station : stations) {
+            vector<KitchenTicket>& queue = station.queue;
+            queue.erase(remove_if(queue.begin(), queue.end(), [&](const KitchenTicket& ticket) {
+                return ticket.generation != tabs[ticket.tableId].generation;
+            }), queue.end());
+            make_heap(queue.begin(), queue.end(), later);
+        }
+        queued -= stale;
+        stale = 0;
+    }
+
+    mutex lock;
+    vector<Route> routes; // by menu position
+    vector<Station> stations;
+    vector<Tab> tabs;     // by table
+    uint64_t nextSeq = 0;
+    size_t queued = 0;    // tickets in all heaps
+    size_t stale = 0;     // of those, tickets for settled or voided tabs
+};
+
+Kitchen kitchen;
+
+// Thread-safe entry point for the business operations. Each table has its
+// own cache-line-sized lock guarding its Table and Order slot, so terminals
+// working different tables never contend. The operations never prompt or
+// print, so the interactive flow and batch mode share the same rules.
+class OrderEngine {
+public:
+    void reset(int tableQty) {
+        locks.reset(new TableLock[tableQty + 1]);
+        tables.assign(tableQty + 1, Table());
+        orders.reset(tableQty);
+        seatIndex.reset(tableQty);
+        kitchen.reset(tableQty);
+    }
+
+    int freeSeats(int tableId) {
+        lock_guard<mutex> guard(locks[tableId].m);
+        return TABLE_CAPACITY - tables[tableId].seatedGuests;
+    }
+
+    // Seats one guest per item at the table and adds their items to its order.
+    // The seat check and the seating happen under the same lock.
+    OpResult place(int tableId, const Entrees* items, int guests) {
+        if (tableId < 1 || tableId > tableQty) return OpResult::NO_SUCH_TABLE;
+        MenuView menu;
+        if (OpResult result = checkItems(*menu, items, guests); result != OpResult::OK) return result;
+        if (!stock.reserve(items, guests)) return OpResult::OUT_OF_STOCK;
+        uint64_t lsn = 0;
+        {
+            lock_guard<mutex> guard(locks[tableId].m);
+            if (guests > TABLE_CAPACITY - tables[tableId].seatedGuests) {
+                releaseStock(items, guests);
+                return OpResult::TABLE_FULL;
+            }
+            lsn = seatAndLog(tableId, items, guests, *menu);
+        }
+        recipes.consume(items, guests, 1);
+        if (wal) wal->commit(lsn);
+        return OpResult::OK;
+    }
+
+    // Seats a party too big for one table across adjacent tables from the
+    // floor plan, splitting guests and their items between them. All the
+    // chosen tables are locked (in table order) while the seats are
+    // re-checked and taken, so the party is seated together or not at all.
+    OpResult placeGroup(const Entrees* items, int guests, vector<int>& tableIds) {
+        MenuView menu;
+        if (OpResult result = checkItems(*menu, items, guests); result != OpResult::OK) return result;
+        if (!stock.reserve(items, guests)) return OpResult::OUT_OF_STOCK;
+        for (;;) {
+            tableIds = planGroup(guests);
+            if (tableIds.empty()) {
+                releaseStock(items, guests);
+                return OpResult::TABLE_FULL;
+            }
+
+            vector<int> lockOrder = tableIds;
+            sort(lockOrder.begin(), lockOrder.end());
+            vector<unique_lock<mutex>> held;
+            int seats = 0;
+            for (int tableId : lockOrder) {
+                held.emplace_back(locks[tableId].m);
+                seats += TABLE_CAPACITY - tables[tableId].seatedGuests;
+            }
+            if (seats < guests) continue; // another terminal got there first
+
+            uint64_t lsn = 0;
+            int seated = 0;
+            for (int tableId : tableIds) {
+                int here = min(guests - seated, TABLE_CAPACITY - tables[tableId].seatedGuests);
+                if (here <= 0) continue;
+                lsn = seatAndLog(tableId, items + seated, here, *menu);
+                seated += here;
+            }
+            held.clear();
+            recipes.consume(items, guests, 1);
+            if (wal) wal->commit(lsn);
+            return OpResult::OK;
+        }
+    }
+
+    // Picks a table for the party by the seating policy, or returns 0.
+    int suggestTable(int guests) { return seatIndex.find(guests, seatingPolicy); }
+
+    // Picks adjacent tables for a party too big for one; empty if none fit.
+    vector<int> planGroup(int guests) {
+        vector<uint8_t> freeSeats;
+        seatIndex.freeSeats(freeSeats);
+        return floorPlan.pack(freeSeats, guests);
+    }
+
+    // Seats the party wherever the seating policy says and reports the table.
+    // If another terminal fills the chosen table first, the search repeats.
+    OpResult placeAnywhere(const Entrees* items, int guests, int& tableId) {
+        for (;;) {
+            tableId = suggestTable(guests);
+            if (tableId == 0) return OpResult::TABLE_FULL;
+            OpResult result = place(tableId, items, guests);
+            if (result != OpResult::TABLE_FULL) return result;
+        }
+    }
+
+    // Marks an order completed by hand, whatever the kitchen still has for it.
+    OpResult complete(int tableId) {
+        if (tableId < 1 || tableId > tableQty) return OpResult::NO_SUCH_TABLE;
+        uint64_t lsn = 0;
+        {
+            lock_guard<mutex> guard(locks[tableId].m);
+            if (!orders.contains(tableId)) return OpResult::NO_ORDER;
+            lsn = completeAndLog(tableId);
+        }
+        if (wal) wal->commit(lsn);
+        return OpResult::OK;
+    }
+
+    // Publishes a menu version with one item changed, and logs the change so
+    // tabs opened under it are priced the same way after a restart.
+    // Terminals keep ordering meanwhile, and open tabs keep the prices they
+    // were opened with.
+    template <typename Fn>
+    OpResult changeMenu(uint32_t sku, Fn&& change) {
+        lock_guard<mutex> guard(menuLock);
+        Entrees item;
+        {
+            MenuView menu;
+            item = menu->find(sku);
+        }
+        if (item == NO_ITEM) return OpResult::INVALID_ITEM;
+        Money price;
+        bool available = false;
+        uint32_t version = 0;
+        bool published = menuBoard.update([&](MenuCatalog& next) {
+            change(next, item);
+            price = next.price(item);
+            available = next.available(item);
+        }, &version);
+        if (!published) return OpResult::MENU_BUSY;
+        if (wal) {
+            lastMenuLsn = wal->append(menuRecord(sku, price, available, version));
+            wal->commit(lastMenuLsn);
+        }
+        return OpResult::OK;
+    }
+
+    // Finishes the next ticket at a kitchen station. If it was the last one
+    // outstanding for its tab, the order is completed. That is re-checked
+    // under the table's lock, in case the tab was voided or given more
+    // dishes in between.
+    OpResult bump(int station, KitchenTicket& ticket, bool& orderCompleted) {
+        bool tabDone = false;
+        orderCompleted = false;
+        if (!kitchen.finishNext(station, ticket, tabDone)) return OpResult::NO_TICKET;
+        if (!tabDone) return OpResult::OK;
+        int tableId = int(ticket.tableId);
+        uint64_t lsn = 0;
+        {
+            lock_guard<mutex> guard(locks[tableId].m);
+            if (!orders.contains(tableId) || orders.at(tableId).isCompleted()) return OpResult::OK;
+            if (!kitchen.ready(ticket.tableId, ticket.generation)) return OpResult::OK;
+            lsn = completeAndLog(tableId);
+            orderCompleted = true;
+        }
+        if (wal) wal->commit(lsn);
+        return OpResult::OK;
+    }
+
+    // Cancels a table's unpaid order. Its items go back into stock, their
+    // ingredients count as unused again, and the party's seats are freed.
+    OpResult voidOrder(int tableId) {
+        if (tableId < 1 || tableId > tableQty) return OpResult::NO_SUCH_TABLE;
+        uint64_t lsn = 0;
+        {
+            lock_guard<mutex> guard(locks[tableId].m);
+            if (!orders.contains(tableId) || orders.at(tableId).isPaid()) return OpResult::NO_ORDER;
+            const Order& order = orders.at(tableId);
+            for (size_t i = 0; i < order.size(); ++i) {
+                stock.release(order.item(i));
+                recipes.consume(order.item(i), -1);
+            }
+            cancel(tableId);
+            if (wal) lsn = locks[tableId].lastLsn = wal->append({{}, uint32_t(tableId), 0, WalType::VOID, 0, 0});
+        }
+        if (wal) wal->commit(lsn);
+        return OpResult::OK;
+    }
+
+    OpResult quote(int tableId, Bill& bill) {
+        if (tableId < 1 || tableId > tableQty) return OpResult::NO_SUCH_TABLE;
+        lock_guard<mutex> guard(locks[tableId].m);
+        if (!orders.contains(tableId)) return OpResult::NO_ORDER;
+        const Order& order = orders.at(tableId);
+        if (order.isPaid()) return OpResult::ALREADY_PAID;
+        if (!order.isCompleted()) return OpResult::NOT_COMPLETED;
+        bill = billFor(order);
+        return OpResult::OK;
+    }
+
+    // Takes payment for a completed order, frees the table and queues the receipt.
+    OpResult pay(int tableId, uint64_t& transId, Bill* charged = nullptr) {
+        if (tableId < 1 || tableId > tableQty) return OpResult::NO_SUCH_TABLE;
+        ReceiptRecord receipt;
+        uint64_t lsn = 0;
+        {
+            lock_guard<mutex> guard(locks[tableId].m);
+            if (!orders.contains(tableId)) return OpResult::NO_ORDER;
+            const Order& order = orders.at(tableId);
+            if (order.isPaid()) return OpResult::ALREADY_PAID;
+            if (!order.isCompleted()) return OpResult::NOT_COMPLETED;
+
+            // Lines are priced from the tab's own menu version.
+            const MenuCatalog& prices = menuBoard.at(order.menuVersion());
+            if (const ItemTally* counts = orders.itemCounts(tableId)) {
+                for (auto [item, qty] : *counts)
+                    receipt.lines.push_back({prices.sku(item), qty, prices.price(item) * qty});
+            }
+
+            Bill bill = billFor(order);
+            if (charged) *charged = bill;
+            settle(tableId);
+            if (wal) lsn = locks[tableId].lastLsn = wal->append({{}, uint32_t(tableId), 0, WalType::PAY, 0, 0});
+
+            receipt.tableId = uint32_t(tableId);
+            receipt.subtotal = bill.subtotal;
+            receipt.tax = bill.tax;
+            receipt.tip = bill.tip;
+            receipt.total = bill.total;
+        }
+        if (wal) wal->commit(lsn);
+        // Receipts are queued in the order their IDs are issued, so the
+        // receipt journal's index stays sorted for lookups.
+        lock_guard<mutex> guard(receiptLock);
+        transId = receipt.transId = transactionIds.next();
+        receiptWriter->submit(move(receipt));
+        return OpResult::OK;
+    }
+
+    // Ends the service day if any tab was opened and every order still on
+    // file is completed and paid; voided tabs are gone. Nothing is
+    // left to recover after that, so the log starts over, and the day's
+    // orders and their arena are released in one go. Every table is locked
+    // meanwhile so no party is seated between the check and the release.
+    bool close() {
+        if (!orders.hadOrders() || !orders.allSettled()) return false;
+        lock_guard<mutex> guard(snapshotLock);
+        vector<unique_lock<mutex>> held;
+        held.reserve(tableQty);
+        for (int tableId = 1; tableId <= tableQty; ++tableId)
+            held.emplace_back(locks[tableId].m);
+        if (!orders.allSettled()) return false; // a table was seated meanwhile
+        if (wal) wal->reset();
+        orders.reset(tableQty);
+        kitchen.reset(tableQty);
+        return true;
+    }
+
+    // Rebuilds state at startup from the latest snapshot plus the log
+    // segments written after it. Replayed transitions change tables, orders
+    // and the menu exactly as the live operations did, but are not logged
+    // again, do not issue receipts and leave stock counts alone. Ingredient
+    // consumption is then recounted from what every table served today,
+    // which counts paid tabs that were since replaced. Records a
+    // table's snapshot already reflects are skipped, so a crash between
+    // writing a snapshot and deleting the segments behind it is harmless.
+    //
+    // Menu versions are numbered afresh in every run, so the log's version
+    // numbers are mapped to the versions recreated here, and each recreated
+    // version stays pinned until the replay ends: a PLACE logged just after
+    // a menu change may still name the version that change replaced. A
+    // number the log never defined refers to the menu replay started from.
+    // Whatever was recovered is then written to a fresh snapshot, so the log
+    // never mixes version numbers from two runs.
+    size_t recover(WriteAheadLog& log, bool& fromSnapshot) {
+        uint64_t menuLsn = 0;
+        fromSnapshot = loadSnapshot(log.basePath() + ".snap", menuLsn);
+        {
+            MenuView base;
+            recoveryBase = base->version();
+        }
+        menuBoard.pin(recoveryBase);
+        size_t replayed = log.recover([&](const WalRecord& record, uint64_t lsn) {
+            if (record.type == WalType::MENU) return lsn > menuLsn && replayMenuChange(record);
+            int tableId = int(record.tableId);
+            if (tableId < 1 || tableId > tableQty || lsn <= locks[tableId].lastLsn) return false;
+            locks[tableId].lastLsn = lsn;
+            switch (record.type) {
+                case WalType::PLACE: {
+                    const MenuCatalog& menu = recoveredMenu(record.menuVersion);
+                    array<Entrees, TABLE_CAPACITY> items;
+                    int guests = min<int>(record.guests, TABLE_CAPACITY);
+                    for (int i = 0; i < guests; ++i)
+                        items[i] = menu.find(record.skus[i]); // NO_ITEM if dropped from the menu
+                    seat(tableId, items.data(), guests, menu);
+                    break;
+                }
+                case WalType::COMPLETE:
+                    if (orders.contains(tableId)) orders.markCompleted(tableId);
+                    break;
+                case WalType::PAY:
+                    if (orders.contains(tableId)) settle(tableId);
+                    break;
+                case WalType::VOID:
+                    if (orders.contains(tableId) && !orders.at(tableId).isPaid()) cancel(tableId);
+                    break;
+                case WalType::MENU:
+                    break;
+            }
+            return true;
+        });
+        releaseRecoveredMenus();
+        menuBoard.unpin(recoveryBase);
+        wal = &log;
+        lastMenuLsn = log.lastLsn();
+
+        vector<uint32_t> itemCounts(MenuView()->size());
+        for (int tableId = 1; tableId <= tableQty; ++tableId)
+            orders.forEachServed(tableId, [&](Entrees item, uint32_t qty) { itemCounts[item] += qty; });
+        recipes.recount(itemCounts);
+        if (fromSnapshot || lastMenuLsn > 0) snapshot();
+        return replayed;
+    }
+
+    // Writes the whole table and order store to <log>.snap and deletes the
+    // log segments it covers. The log is rotated first, then each table is
+    // copied into the image under its own lock, so order entry only ever
+    // waits for one table's copy, never for the file write. A table copied
+    // after the rotation may already include newer records; its lastLsn tells
+    // recovery to skip those.
+    bool snapshot() {
+        lock_guard<mutex> guard(snapshotLock);
+        if (!wal) return false;
+        uint64_t boundary = 0;
+        uint32_t segment = wal->rotate(boundary);
+
+        SnapshotHeader header = {{}, uint32_t(tableQty), 0, boundary, 0, 0, uint32_t(orders.hadOrders())};
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+        // Every menu version an order is priced against is stored once, and
+        // pinned until the image is complete so its number is not reused.
+        menuImage.clear();
+        vector<uint32_t> stored;
+        auto storeMenu = [&](const MenuCatalog& version) {
+            if (std::find(stored.begin(), stored.end(), version.version()) != stored.end()) return;
+            stored.push_back(version.version());
+            menuBoard.pin(version.version());
+            SnapshotMenu entry = {version.version(), uint32_t(version.size())};
+            menuImage.append(reinterpret_cast<const char*>(&entry), sizeof(entry));
+            for (Entrees item = 0; item < version.size(); ++item) {
+                int64_t cents = version.price(item).cents;
+                menuImage.append(reinterpret_cast<const char*>(&cents), sizeof(cents));
+            }
+            for (Entrees item = 0; item < version.size(); ++item)
+                menuImage.push_back(char(version.available(item)));
+        };
+        {
+            lock_guard<mutex> menuGuard(menuLock);
+            MenuView live;
+            header.menuLsn = lastMenuLsn;
+            header.liveVersion = live->version();
+            storeMenu(*live);
+        }
+
+        image.clear();
+        MenuView menu; // SKUs are the same in every version
+        for (int tableId = 1; tableId <= tableQty; ++tableId) {
+            lock_guard<mutex> tableGuard(locks[tableId].m);
+            SnapshotTable entry;
+            entry.lastLsn = locks[tableId].lastLsn;
+            entry.seatedGuests = uint8_t(tables[tableId].seatedGuests);
+            const Order* order = orders.contains(tableId) ? &orders.at(tableId) : nullptr;
+            if (order) {
+                entry.state = uint8_t(order->status());
+                entry.itemQty = uint32_t(order->size());
+                entry.menuVersion = order->menuVersion();
+                storeMenu(menuBoard.at(entry.menuVersion));
+            }
+            const ItemTally* earlier = orders.earlierCounts(tableId);
+            entry.servedQty = earlier ? earlier->size : 0;
+            image.append(reinterpret_cast<const char*>(&entry), sizeof(entry));
+            for (uint32_t i = 0; i < entry.itemQty; ++i) {
+                uint32_t sku = menu->sku(order->item(i));
+                image.append(reinterpret_cast<const char*>(&sku), sizeof(sku));
+            }
+            for (uint32_t i = 0; i < entry.servedQty; ++i) {
+                const ItemTally::Entry& served = earlier->begin()[i];
+                uint32_t pair[2] = {menu->sku(served.item), served.qty};
+                image.append(reinterpret_cast<const char*>(pair), sizeof(pair));
+            }
+        }
+
+        for (uint32_t version : stored)
+            menuBoard.unpin(version);
+        header.menuQty = uint32_t(stored.size());
+
+        string path = wal->basePath() + ".snap";
+        string tmpPath = path + ".tmp";
+        FILE* out = fopen(tmpPath.c_str(), "wb");
+        if (!out) return false;
+        bool ok = fwrite(&header, sizeof(header), 1, out) == 1
+               && fwrite(menuImage.data(), 1, menuImage.size(), out) == menuImage.size()
+               && fwrite(image.data(), 1, image.size(), out) == image.size();
+        syncFile(out);
+        fclose(out);
+        if (!ok || !replaceFile(tmpPath, path)) return false;
+        wal->dropSegmentsBefore(segment);
+        return true;
+    }
+
+    OrderStatus status(int tableId) {
+        lock_guard<mutex> guard(locks[tableId].m);
+        if (!orders.contains(tableId)) return OrderStatus::NONE;
+        return orders.at(tableId).status();
+    }
+
+private:
+    struct alignas(64) TableLock {
+        mutex m;
+        uint64_t lastLsn = 0; // newest log record applied to this table
+    };
+
+    static constexpr char SNAPSHOT_MAGIC[8] = {'R', 'M', 'S', 'S', 'N', 'A', 'P', '5'};
+
+    // Followed by menuQty SnapshotMenus, then one SnapshotTable per table.
+    struct SnapshotHeader {
+        char magic[8];
+        uint32_t tableQty;
+        uint32_t menuQty;
+        uint64_t lsn;         // every log record up to here is reflected
+        uint64_t menuLsn;     // every menu change up to here is reflected
+        uint32_t liveVersion; // the stored version that was live
+        uint32_t hadOrders;   // 1 if any tab was opened that day
+    };
+
+    // Followed by itemQty int64 prices in cents, then itemQty uint8 flags
+    // that are 1 for items on the menu, both by menu position.
+    struct SnapshotMenu {
+        uint32_t version;
+        uint32_t itemQty;
+    };
+
+    // Followed by itemQty uint32 SKUs, in the order the items were added,
+    // then servedQty uint32 pairs of a SKU and how many the table's earlier,
+    // paid tabs served.
+    struct SnapshotTable {
+        uint64_t lastLsn = 0;
+        uint8_t seatedGuests = 0;
+        uint8_t state = 0; // an OrderStatus
+        uint16_t reserved = 0;
+        uint32_t itemQty = 0;
+        uint32_t menuVersion = 0; // the version the order is priced against
+        uint32_t servedQty = 0;
+    };
+
+    // Restores the menu and tables from a snapshot written by snapshot(),
+    // and reports in menuLsn the last menu change it reflects. The file is
+    // mapped rather than read where the platform allows it.
+    bool loadSnapshot(const string& path, uint64_t& menuLsn) {
+        FILE* in = fopen(path.c_str(), "rb");
+        if (!in) return false;
+        fseek(in, 0, SEEK_END);
+        long size = ftell(in);
+        fseek(in, 0, SEEK_SET);
+        if (size < long(sizeof(SnapshotHeader))) {
+            fclose(in);
+            return false;
+        }
+#ifdef _WIN32
+        vector<char> buffer(size);
+        const char* data = fread(buffer.data(), 1, size, in) == size_t(size) ? buffer.data() : nullptr;
+#else
+        void* mapped = mmap(nullptr, size_t(size), PROT_READ, MAP_PRIVATE, fileno(in), 0);
+        const char* data = mapped == MAP_FAILED ? nullptr : static_cast<const char*>(mapped);
+#endif
+        fclose(in);
+        if (!data) return false;
+
+        SnapshotHeader header;
+        memcpy(&header, data, sizeof(header));
+        bool valid = memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) == 0;
+        const char* pos = data + sizeof(header);
+        const char* end = data + size;
+        menuLsn = header.menuLsn;
+        if (valid && header.hadOrders) orders.markHadOrders();
+
+        // The live version is recreated last so that it ends up live. Stored
+        // versions only apply to the same menu file they were taken from.
+        vector<pair<SnapshotMenu, const char*>> stored;
+        for (uint32_t i = 0; valid && i < header.menuQty; ++i) {
+            SnapshotMenu entry;
+            valid = size_t(end - pos) >= sizeof(entry);
+            if (!valid) break;
+            memcpy(&entry, pos, sizeof(entry));
+            pos += sizeof(entry);
+            valid = size_t(end - pos) / (sizeof(int64_t) + 1) >= entry.itemQty;
+            if (!valid) break;
+            stored.push_back({entry, pos});
+            pos += entry.itemQty * (sizeof(int64_t) + 1);
+        }
+        stable_partition(stored.begin(), stored.end(),
+                         [&](const auto& version) { return version.first.version != header.liveVersion; });
+        size_t menuSize = MenuView()->size();
+        for (const auto& [entry, prices] : stored) {
+            if (!valid || entry.itemQty != menuSize) continue;
+            recreateMenu(entry.version, [&, prices = prices](MenuCatalog& next) {
+                const char* flags = prices + entry.itemQty * sizeof(int64_t);
+                for (Entrees item = 0; item < entry.itemQty; ++item) {
+                    Money price;
+                    memcpy(&price.cents, prices + item * sizeof(int64_t), sizeof(int64_t));
+                    next.setPrice(item, price);
+                    next.setAvailable(item, flags[item] != 0);
+                }
+            });
+        }
+
+        int restored = min<int>(header.tableQty, tableQty);
+        MenuView menu;
+        vector<Entrees> items;
+        vector<ItemTally::Entry> served;
+        for (int tableId = 1; valid && tableId <= restored; ++tableId) {
+            SnapshotTable entry;
+            valid = size_t(end - pos) >= sizeof(entry);
+            if (!valid) break;
+            memcpy(&entry, pos, sizeof(entry));
+            pos += sizeof(entry);
+            valid = size_t(end - pos) / sizeof(uint32_t) >= entry.itemQty + 2 * uint64_t(entry.servedQty);
+            if (!valid) break;
+            items.resize(entry.itemQty);
+            for (Entrees& item : items) {
+                uint32_t sku;
+                memcpy(&sku, pos, sizeof(sku));
+                pos += sizeof(sku);
+                item = menu->find(sku);
+            }
+            served.clear();
+            for (uint32_t i = 0; i < entry.servedQty; ++i) {
+                uint32_t pair[2];
+                memcpy(pair, pos, sizeof(pair));
+                pos += sizeof(pair);
+                Entrees item = menu->find(pair[0]);
+                if (item != NO_ITEM) served.push_back({item, pair[1]});
+            }
+            auto recreated = recoveredMenus.find(entry.menuVersion);
+            restoreTable(tableId, entry, items, recreated == recoveredMenus.end() ? *menu : menuBoard.at(recreated->second));
+            orders.restoreEarlier(tableId, served);
+        }
+        if (!valid) cerr << "Ignoring unreadable snapshot '" << path << "'.\n";
+#ifndef _WIN32
+        munmap(const_cast<char*>(data), size_t(size));
+#endif
+        return valid;
+    }
+
+    // Recreates a menu version the log or a snapshot knew as number logged,
+    // keeping it pinned until releaseRecoveredMenus(). If every version
+    // number is in use, the versions recreated so far are let go first, and
+    // orders naming them are priced from the menu replay started from.
+    template <typename Fn>
+    void recreateMenu(uint32_t logged, Fn&& change) {
+        uint32_t version = 0;
+        if (!menuBoard.update(change, &version)) {
+            releaseRecoveredMenus();
+            if (!menuBoard.update(change, &version)) return;
+        }
+        menuBoard.pin(version);
+        auto [mapped, added] = recoveredMenus.try_emplace(logged, version);
+        if (!added) {
+            menuBoard.unpin(mapped->second);
+            mapped->second = version;
+        }
+    }
+
+    void releaseRecoveredMenus() {
+        for (auto [logged, version] : recoveredMenus)
+            menuBoard.unpin(version);
+        recoveredMenus.clear();
+    }
+
+    const MenuCatalog& recoveredMenu(uint32_t logged) const {
+        auto recreated = recoveredMenus.find(logged);
+        return menuBoard.at(recreated == recoveredMenus.end() ? recoveryBase : recreated->second);
+    }
+
+    bool replayMenuChange(const WalRecord& record) {
+        Entrees item;
+        {
+            MenuView menu;
+            item = menu->find(record.skus[0]);
+        }
+        if (item == NO_ITEM) return false; // dropped from the menu file
+        Money price;
+        memcpy(&price.cents, &record.skus[2], sizeof(price.cents));
+        recreateMenu(record.menuVersion, [&](MenuCatalog& next) {
+            next.setPrice(item, price);
+            next.setAvailable(item, record.guests != 0);
+        });
+        return true;
+    }
+
+    static WalRecord menuRecord(uint32_t sku, Money price, bool available, uint32_t version) {
+        WalRecord record = {{sku}, 0, version, WalType::MENU, uint8_t(available), 0};
+        memcpy(&record.skus[2], &price.cents, sizeof(price.cents));
+        return record;
+    }
+
+    void restoreTable(int tableId, const SnapshotTable& entry, const vector<Entrees>& items, const MenuCatalog& menu) {
+        locks[tableId].lastLsn = entry.lastLsn;
+        tables[tableId].seatedGuests = min<int>(entry.seatedGuests, TABLE_CAPACITY);
+        seatIndex.update(tableId, TABLE_CAPACITY - tables[tableId].seatedGuests);
+        if (entry.state == uint8_t(OrderStatus::NONE)) return;
+        orders.open(tableId, menu.version());
+        orders.addItems(tableId, items.data(), items.size(), menu);
+        if (entry.state >= uint8_t(OrderStatus::AWAITING_PAYMENT)) orders.markCompleted(tableId);
+        if (entry.state == uint8_t(OrderStatus::ALL_DONE)) orders.markPaid(tableId);
+    }
+
+    static OpResult checkItems(const MenuCatalog& menu, const Entrees* items, int guests) {
+        for (int i = 0; i < guests; ++i) {
+            if (items[i] >= menu.size()) return OpResult::INVALID_ITEM;
+            if (!menu.available(items[i])) return OpResult::ITEM_UNAVAILABLE;
+        }
+        return OpResult::OK;
+    }
+
+    // The caller holds the table's lock. Returns the log record's LSN, if logging.
+    uint64_t seatAndLog(int tableId, const Entrees* items, int guests, const MenuCatalog& menu) {
+        seat(tableId, items, guests, menu);
+        kitchen.fire(tableId, items, guests);
+        if (!wal) return 0;
+        WalRecord record = {{}, uint32_t(tableId), orders.at(tableId).menuVersion(), WalType::PLACE, uint8_t(guests), 0};
+        for (int i = 0; i < guests; ++i)
+            record.skus[i] = menu.sku(items[i]);
+        return locks[tableId].lastLsn = wal->append(record);
+    }
+
+    // Shared by the live operations and recovery; the caller holds the table's
+    // lock. Recovery may pass NO_ITEM for an item no longer on the menu; the
+    // guest is still seated. A new tab is priced against menu, the live
+    // version; an open tab keeps the version it started with.
+    void seat(int tableId, const Entrees* items, int guests, const MenuCatalog& menu) {
+        tables[tableId].seatedGuests += guests;
+        seatIndex.update(tableId, TABLE_CAPACITY - tables[tableId].seatedGuests);
+        Order& order = orders.open(tableId, menu.version());
+        orders.addItems(tableId, items, size_t(guests), menuBoard.at(order.menuVersion()));
+    }
+
+    // The caller holds the table's lock.
+    uint64_t completeAndLog(int tableId) {
+        orders.markCompleted(tableId);
+        if (!wal) return 0;
+        return locks[tableId].lastLsn = wal->append({{}, uint32_t(tableId), 0, WalType::COMPLETE, 0, 0});
+    }
+
+    static void releaseStock(const Entrees* items, int guests) {
+        for (int i = 0; i < guests; ++i)
+            stock.release(items[i]);
+    }
+
+    void cancel(int tableId) {
+        kitchen.clear(tableId);
+        orders.remove(tableId);
+        tables[tableId].seatedGuests = 0;
+        seatIndex.update(tableId, TABLE_CAPACITY);
+    }
+
+    void settle(int tableId) {
+        kitchen.clear(tableId);
+        orders.markPaid(tableId);
+        tables[tableId].seatedGuests = 0;
+        seatIndex.update(tableId, TABLE_CAPACITY);
+    }
+
+    unique_ptr<TableLock[]> locks;
+    SeatIndex seatIndex;
+    WriteAheadLog* wal = nullptr;
+    mutex snapshotLock;
+    mutex receiptLock;
+    mutex menuLock;           // orders menu changes with their log records
+    uint64_t lastMenuLsn = 0; // guarded by menuLock
+    unordered_map<uint32_t, uint32_t> recoveredMenus; // logged version number -> recreated one
+    uint32_t recoveryBase = 0;
+    string image;             // reused between snapshots
+    string menuImage;         // likewise
+};
+
+OrderEngine engine;
+
+// Takes a snapshot on a background thread whenever enough events have been
+// logged since the last one, which keeps the log tail that a restart has to
+// replay short.
+class SnapshotScheduler {
+public:
+    SnapshotScheduler(WriteAheadLog& log, uint64_t everyEvents)
+        : log(log), everyEvents(everyEvents), worker([this] { run(); }) {}
+
+    ~SnapshotScheduler() {
+        {
+            lock_guard<mutex> guard(sleepLock);
+            stopping = true;
+        }
+        wakeup.notify_one();
+        worker.join();
+    }
+
+private:
+    void run() {
+        uint64_t covered = log.lastLsn();
+        unique_lock<mutex> guard(sleepLock);
+        while (!wakeup.wait_for(guard, chrono::milliseconds(50), [this] { return stopping; })) {
+            uint64_t lsn = log.lastLsn();
+            if (lsn - covered < everyEvents) continue;
+            guard.unlock();
+            if (engine.snapshot()) covered = lsn;
+            guard.lock();
+        }
+    }
+
+    WriteAheadLog& log;
+    const uint64_t everyEvents;
+    bool stopping = false;
+    mutex sleepLock;
+    condition_variable wakeup;
+    thread worker;
+};
+
+void initializeTables() {
+    engine.reset(tableQty);
+    if (floorPlan.empty()) floorPlan = FloorPlan::linear(tableQty);
+}
+
+// Reads input a large block at a time straight from a file descriptor and
+// parses tokens in place with from_chars: no locale, no per-token allocation.
+// Views returned by word() stay valid until the next read.
+class InputReader {
+public:
+    // An interactive reader flushes the console before it blocks, so the
+    // pending prompt is on screen.
+    InputReader(int fd, bool interactive)
+        : fd(fd), interactive(interactive), buf(new char[INPUT_BLOCK_BYTES]) {}
 
-struct Table {
-    int capacity = TABLE_CAPACITY;
-    int seatedGuests = 0;
+    bool atEnd() { return peek() < 0; }
+
+    // Parses an integer the way `cin >> int` does: optional sign, then
+    // digits, leaving anything after them unread. Whitespace before the
+    // number is skipped, including newlines when crossLines is set.
+    bool readInt(int& value, bool crossLines) {
+        skipBlanks(crossLines);
+        size_t n = tokenLength([](char c, size_t i) {
+            return (c >= '0' && c <= '9') || (i == 0 && (c == '+' || c == '-'));
+        });
+        const char* first = buf.get() + pos;
+        const char* last = first + n;
+        if (n > 1 && *first == '+' && first[1] != '-') ++first; // from_chars rejects '+'
+        auto parsed = from_chars(first, last, value);
+        if (parsed.ec != errc() || parsed.ptr != last) return false;
+        pos += n;
+        return true;
+    }
+
+    // Skips whitespace (including newlines) and reads one character.
+    bool readChar(char& c) {
+        skipBlanks(true);
+        int next = peek();
+        if (next < 0) return false;
+        c = char(next);
+        ++pos;
+        return true;
+    }
+
+    // Returns the next whitespace-delimited word on the current line.
+    string_view word() {
+        skipBlanks(false);
+        size_t n = tokenLength([](char c, size_t) { return !isspace(static_cast<unsigned char>(c)); });
+        string_view token(buf.get() + pos, n);
+        pos += n;
+        return token;
+    }
+
+    // True if nothing but blanks or a '#' comment is left on the current line.
+    bool atLineEnd() {
+        skipBlanks(false);
+        int next = peek();
+        return next < 0 || next == '\n' || next == '#';
+    }
+
+    // Discards everything up to and including the next newline.
+    void skipLine() {
+        for (;;) {
+            const char* start = buf.get() + pos;
+            const char* nl = static_cast<const char*>(memchr(start, '\n', len - pos));
+            if (nl) {
+                pos += size_t(nl - start) + 1;
+                return;
+            }
+            pos = len;
+            if (!fill()) return;
+        }
+    }
+
+private:
+    int peek() {
+        if (pos == len && !fill()) return -1;
+        return static_cast<unsigned char>(buf[pos]);
+    }
+
+    void skipBlanks(bool crossLines) {
+        for (int c; (c = peek()) >= 0 && isspace(c) && (crossLines || c != '\n');)
+            ++pos;
+    }
+
+    // Length of the token at pos, refilling as needed so it is fully buffered.
+    template <typename Pred>
+    size_t tokenLength(Pred accept) {
+        size_t n = 0;
+        for (;;) {
+            while (pos + n < len && accept(buf[pos + n], n)) ++n;
+            if (pos + n < len || n == INPUT_BLOCK_BYTES || !fill()) return n;
+        }
+    }
+
+    // Moves unread bytes to the front and reads more after them.
+    bool fill() {
+        memmove(buf.get(), buf.get() + pos, len - pos);
+        len -= pos;
+        pos = 0;
+        if (eof || len == INPUT_BLOCK_BYTES) return false;
+        if (interactive) {
+            consoleErr.flush();
+            console.flush();
+        }
+#ifdef _WIN32
+        long got = _read(fd, buf.get() + len, unsigned(INPUT_BLOCK_BYTES - len));
+#else
+        long got = read(fd, buf.get() + len, INPUT_BLOCK_BYTES - len);
+#endif
+        if (got <= 0) {
+            eof = true;
+            return false;
+        }
+        len += size_t(got);
+        return true;
+    }
+
+    const int fd;
+    const bool interactive;
+    unique_ptr<char[]> buf;
+    size_t pos = 0, len = 0;
+    bool eof = false;
+};
+
+InputReader input(0, true);
+
+// Coroutine frames for session flows come from per-size free lists, so each
+// new flow reuses the frame of a finished one instead of going to the heap.
+class FramePool {
+public:
+    static void* allocate(size_t size) {
+        size_t bucket = (size + 63) / 64;
+        if (bucket >= FRAME_POOL_BUCKETS) return ::operator new(size);
+        if (FreeFrame* frame = freeLists[bucket]) {
+            freeLists[bucket] = frame->next;
+            return frame;
+        }
+        return ::operator new(bucket * 64);
+    }
+
+    static void release(void* p, size_t size) {
+        size_t bucket = (size + 63) / 64;
+        if (bucket >= FRAME_POOL_BUCKETS) {
+            ::operator delete(p);
+            return;
+        }
+        FreeFrame* frame = static_cast<FreeFrame*>(p);
+        frame->next = freeLists[bucket];
+        freeLists[bucket] = frame;
+    }
+
+private:
+    struct FreeFrame {
+        FreeFrame* next;
+    };
+
+    static thread_local inline FreeFrame* freeLists[FRAME_POOL_BUCKETS] = {};
 };
 
-struct Order {
-    vector<Entrees> items;
-    bool isCompleted = false;
-    bool isPaid = false;
+// A step of a terminal session, written as a coroutine. A task starts
+// suspended and runs when awaited (or start()ed, for the outermost one).
+// When it finishes, it resumes whoever awaited it.
+class Task {
+public:
+    struct promise_type {
+        coroutine_handle<> continuation;
+
+        Task get_return_object() { return Task(coroutine_handle<promise_type>::from_promise(*this)); }
+        suspend_always initial_suspend() noexcept { return {}; }
+        auto final_suspend() noexcept {
+            struct ResumeContinuation {
+                bool await_ready() noexcept { return false; }
+                coroutine_handle<> await_suspend(coroutine_handle<promise_type> h) noexcept {
+                    coroutine_handle<> next = h.promise().continuation;
+                    return next ? next : noop_coroutine();
+                }
+                void await_resume() noexcept {}
+            };
+            return ResumeContinuation{};
+        }
+        void return_void() {}
+        void unhandled_exception() { terminate(); }
+
+        static void* operator new(size_t size) { return FramePool::allocate(size); }
+        static void operator delete(void* p, size_t size) { FramePool::release(p, size); }
+    };
+
+    Task(Task&& other) noexcept : handle(exchange(other.handle, {})) {}
+    ~Task() {
+        if (handle) handle.destroy();
+    }
+
+    void start() { handle.resume(); }
+    bool done() const { return !handle || handle.done(); }
+
+    bool await_ready() const noexcept { return false; }
+    coroutine_handle<> await_suspend(coroutine_handle<> caller) noexcept {
+        handle.promise().continuation = caller;
+        return handle;
+    }
+    void await_resume() noexcept {}
+
+private:
+    explicit Task(coroutine_handle<promise_type> handle) : handle(handle) {}
+
+    coroutine_handle<promise_type> handle;
 };
 
-map<int, Table> tables;
-map<int, Order> orders;
+// A session's view of its terminal: where its screen text goes, and the
+// prompt it is suspended on. A driver feeds input through provideNumber and
+// provideChar, which apply the checkNum rules: a bad or out-of-range number
+// is answered with "Invalid input" and the prompt again.
+class SessionIo {
+public:
+    // With a console, text goes straight to it and errors to stderr.
+    // Without one, everything collects in text() for the driver to forward,
+    // unless the session is muted.
+    explicit SessionIo(Console* console, bool muted = false) : console(console), muted(muted) {}
 
-bool allOrdersPaidAndComplete() {
-    for (const auto& [tableId, order] : orders) {
-        if (!order.isCompleted || !order.isPaid)
+    template <typename T>
+    SessionIo& operator<<(const T& value) {
+        if (console) *console << value;
+        else if (!muted) buffer << value;
+        return *this;
+    }
+
+    void error(string_view message) {
+        if (console) {
+            console->flush();
+            cerr << message << flush;
+        } else if (!muted) {
+            buffer << message;
+        }
+    }
+
+    struct NumberPrompt {
+        SessionIo& io;
+        int min, max;
+        string_view prompt;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(coroutine_handle<> h) { io.suspendOn(h, false, min, max, prompt); }
+        int await_resume() const noexcept { return io.number; }
+    };
+
+    struct CharPrompt {
+        SessionIo& io;
+        string_view prompt;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(coroutine_handle<> h) { io.suspendOn(h, true, 0, 0, prompt); }
+        char await_resume() const noexcept { return io.letter; }
+    };
+
+    NumberPrompt askNumber(int min, int max, string_view prompt) { return {*this, min, max, prompt}; }
+    CharPrompt askChar(string_view prompt) { return {*this, prompt}; }
+
+    bool wantsChar() const { return expectingChar; }
+
+    // Returns false if the value was rejected; the driver should then drop
+    // the rest of that input line, as checkNum did.
+    bool provideNumber(bool parsed, int value) {
+        if (!parsed || value < min || value > max) {
+            *this << "Invalid input. Try again.\n" << string_view(prompt);
             return false;
+        }
+        number = value;
+        exchange(waiting, {}).resume();
+        return true;
     }
-    return true;
-}
 
-void initializeTables() {
-    for (int i = 1; i <= TABLE_QTY; ++i)
-        tables[i] = Table();
+    void provideChar(char c) {
+        letter = c;
+        exchange(waiting, {}).resume();
+    }
+
+    TextBuffer& text() { return buffer; }
+
+private:
+    void suspendOn(coroutine_handle<> h, bool wantsChar, int lo, int hi, string_view text) {
+        waiting = h;
+        expectingChar = wantsChar;
+        min = lo;
+        max = hi;
+        prompt.assign(text);
+        *this << text;
+    }
+
+    Console* const console;
+    const bool muted;
+    TextBuffer buffer;
+    coroutine_handle<> waiting;
+    bool expectingChar = false;
+    int min = 0, max = 0;
+    string prompt;
+    int number = 0;
+    char letter = 0;
+};
+
+size_t menuPages() {
+    MenuView menu;
+    return (menu->size() + MENU_PAGE_ITEMS - 1) / MENU_PAGE_ITEMS;
 }
 
-void showMenu() {
-    cout << "--- Menu ---\n";
-    for (size_t i = 0; i < entreeNames.size(); ++i)
-        cout << (i + 1) << ". " << entreeNames[i] << " - $" << entreePrices[i] << "\n";
+// Prints one page of the live menu, listing items by their item number (SKU).
+// Items that have been 86'd or have sold out are left out.
+void showMenu(SessionIo& io, size_t page = 0) {
+    MenuView menu;
+    io << "--- Menu ";
+    if (menuPages() > 1) io << "(page " << (page + 1) << " of " << menuPages() << ") ";
+    io << "---\n";
+    size_t last = min(menu->size(), (page + 1) * MENU_PAGE_ITEMS);
+    for (size_t i = page * MENU_PAGE_ITEMS; i < last; ++i) {
+        Entrees item = Entrees(i);
+        if (menu->available(item) && stock.inStock(item)) io << menu->sku(item) << ". " << menu->name(item) << " - $" << menu->price(item) << "\n";
+    }
 }
 
-int checkNum(int min, int max, const string& prompt) {
-    int val;
-    while (true) {
-        cout << prompt;
-        cin >> val;
-        if (cin.fail() || val < min || val > max) {
-            cin.clear();
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cout << "Invalid input. Try again.\n";
-        } else {
-            return val;
+// Asks each guest for an item number. With a menu longer than one page,
+// entering 0 shows the next page. Each answer is checked against the menu
+// live at that moment.
+Task takeItems(SessionIo& io, Entrees* items, int guests) {
+    size_t page = 0, pages = menuPages();
+    uint32_t minSku, maxSku;
+    {
+        MenuView menu;
+        minSku = menu->minSku();
+        maxSku = menu->maxSku();
+    }
+    showMenu(io, page);
+    int guest = 0;
+    while (guest < guests) {
+        string prompt = "Guest " + to_string(guest + 1) + ", enter item number" + (pages > 1 ? " (0 for more)" : "") + ": ";
+        int sku = co_await io.askNumber(pages > 1 ? 0 : int(minSku), int(maxSku), prompt);
+        if (sku == 0) {
+            page = (page + 1) % pages;
+            showMenu(io, page);
+            continue;
+        }
+        MenuView menu;
+        Entrees item = menu->find(uint32_t(sku));
+        if (item == NO_ITEM) {
+            io << "Invalid input. Try again.\n";
+            continue;
+        }
+        if (!menu->available(item)) {
+            io << "Sorry! That item is no longer available.\n";
+            continue;
+        }
+        if (!stock.inStock(item)) {
+            io << "Sorry! That item is sold out.\n";
+            continue;
         }
+        items[guest++] = item;
+    }
+}
+
+// Lets the seating policy pick the table once the party size is known.
+// Seats a party bigger than one table at adjacent tables.
+Task placeGroupOrder(SessionIo& io, int guests) {
+    if (engine.planGroup(guests).empty()) {
+        io << "Sorry! No adjacent tables have room for " << guests << " guests.\n";
+        co_return;
+    }
+
+    vector<Entrees> items(guests);
+    co_await takeItems(io, items.data(), guests);
+
+    vector<int> tableIds;
+    OpResult result = engine.placeGroup(items.data(), guests, tableIds);
+    if (result == OpResult::TABLE_FULL) {
+        io << "Sorry! The tables filled up while ordering.\n";
+        co_return;
+    }
+    if (result != OpResult::OK) {
+        io << "Sorry! The order could not be placed: " << describe(result) << ".\n";
+        co_return;
+    }
+    io << "Order placed for tables ";
+    for (size_t i = 0; i < tableIds.size(); ++i) {
+        if (i > 0) io << (i + 1 == tableIds.size() ? " and " : ", ");
+        io << tableIds[i];
     }
+    io << " successfully.\n";
 }
 
-void placeOrder() {
-    int tableId = checkNum(1, TABLE_QTY, "Enter table number (1-" + to_string(TABLE_QTY) + "): ");
-    Table& table = tables[tableId];
+Task placeOrderAnywhere(SessionIo& io) {
+    int guests = co_await io.askNumber(1, tableQty * TABLE_CAPACITY, "Enter number of guests to seat: ");
+    if (guests > TABLE_CAPACITY) {
+        co_await placeGroupOrder(io, guests);
+        co_return;
+    }
+    if (!engine.suggestTable(guests)) {
+        io << "Sorry! No table has room for " << guests << " guest" << (guests == 1 ? "" : "s") << ".\n";
+        co_return;
+    }
+
+    array<Entrees, TABLE_CAPACITY> items;
+    co_await takeItems(io, items.data(), guests);
+
+    int tableId = 0;
+    OpResult result = engine.placeAnywhere(items.data(), guests, tableId);
+    if (result == OpResult::TABLE_FULL) {
+        io << "Sorry! Every table filled up while ordering.\n";
+        co_return;
+    }
+    if (result != OpResult::OK) {
+        io << "Sorry! The order could not be placed: " << describe(result) << ".\n";
+        co_return;
+    }
+    io << "Order placed for table " << tableId << " successfully.\n";
+}
 
-    int availableSeats = TABLE_CAPACITY - table.seatedGuests;
+Task placeOrder(SessionIo& io) {
+    string prompt = "Enter table number (1-" + to_string(tableQty) + ", 0 for any table): ";
+    int tableId = co_await io.askNumber(0, tableQty, prompt);
+    if (tableId == 0) {
+        co_await placeOrderAnywhere(io);
+        co_return;
+    }
+    int availableSeats = engine.freeSeats(tableId);
     if (availableSeats <= 0) {
-        cout << "Sorry! Table " << tableId << " is full.\n";
-        return;
+        io << "Sorry! Table " << tableId << " is full.\n";
+        co_return;
     }
     // I got creative with this logic to make it prettier and more fun :)
     if (availableSeats <= 2) {
-        cout << "\nAct quickly! ";
-        cout << "Only " << availableSeats << " seat" << (availableSeats == 1 ? "" : "s") << " left at this table.\n" << endl;
+        io << "\nAct quickly! ";
+        io << "Only " << availableSeats << " seat" << (availableSeats == 1 ? "" : "s") << " left at this table.\n\n";
     } else {
-        cout << "\nNotice:\n";
-        cout << "There " << (availableSeats == 1 ? "is" : "are") << " " 
-             << availableSeats << " seat" << (availableSeats == 1 ? "" : "s") 
-             << " available at this table.\n" << endl;
+        io << "\nNotice:\n";
+        io << "There " << (availableSeats == 1 ? "is" : "are") << " "
+           << availableSeats << " seat" << (availableSeats == 1 ? "" : "s")
+           << " available at this table.\n\n";
     }
 
-    int guests = checkNum(1, availableSeats, "Enter number of guests to seat: ");
-    table.seatedGuests += guests;
+    int guests = co_await io.askNumber(1, availableSeats, "Enter number of guests to seat: ");
 
-    showMenu();
-    vector<Entrees> items;
-    for (int i = 0; i < guests; ++i) {
-        int choice = checkNum(1, entreeNames.size(), "Guest " + to_string(i + 1) + ", enter item number: ");
-        items.push_back(static_cast<Entrees>(choice - 1));
-    }
+    array<Entrees, TABLE_CAPACITY> items;
+    co_await takeItems(io, items.data(), guests);
 
-    orders[tableId].items.insert(orders[tableId].items.end(), items.begin(), items.end());
-    cout << "Order placed for table " << tableId << " successfully.\n";
+    OpResult result = engine.place(tableId, items.data(), guests);
+    if (result == OpResult::TABLE_FULL) {
+        io << "Sorry! Table " << tableId << " filled up while ordering.\n";
+        co_return;
+    }
+    if (result != OpResult::OK) {
+        io << "Sorry! The order could not be placed: " << describe(result) << ".\n";
+        co_return;
+    }
+    io << "Order placed for table " << tableId << " successfully.\n";
 }
 
-void checkTableStatus() {
-    for (int tableId = 1; tableId <= TABLE_QTY; ++tableId) {
-        if (orders.count(tableId)) {
-            cout << "Table #" << tableId << " status: ";
-            const Order& order = orders[tableId];
-            cout << (!order.isCompleted ? "awaiting completion"
-                  : !order.isPaid      ? "awaiting payment"
-                                       : "all done") << endl;
-        }
-    }
+void checkTableStatus(SessionIo& io) {
+    orders.forEach([&](int tableId, const Order& order) {
+        io << "Table #" << tableId << " status: ";
+        io << (!order.isCompleted() ? "awaiting completion"
+             : !order.isPaid()      ? "awaiting payment"
+                                    : "all done") << "\n";
+    });
 }
 
-int checkOrderAndTableStatus(const string& promptMessage) {
+// Lists table statuses ahead of a table prompt; false if nothing is pending.
+bool showPendingTables(SessionIo& io) {
     if (!allOrdersPaidAndComplete()) {
-        checkTableStatus();
-        return checkNum(1, TABLE_QTY, promptMessage);
+        checkTableStatus(io);
+        return true;
     } else {
-        cout << "No pending orders / all have been completed and paid.\n";
-        return -1;
+        io << "No pending orders / all have been completed and paid.\n";
+        return false;
     }
 }
 
-void completeOrder() {
-    int tableId = checkOrderAndTableStatus("Enter table number to complete order: ");
-    if (tableId == -1) return;
+Task completeOrder(SessionIo& io) {
+    if (!showPendingTables(io)) co_return;
+    int tableId = co_await io.askNumber(1, tableQty, "Enter table number to complete order: ");
 
-    if (!orders.count(tableId)) {
-        cerr << "No order found for Table " << tableId << ".\n";
-        return;
+    if (engine.complete(tableId) == OpResult::NO_ORDER) {
+        io.error("No order found for Table " + to_string(tableId) + ".\n");
+        co_return;
     }
 
-    orders[tableId].isCompleted = true;
-    cout << "Order for table " << tableId << ": "
-         << "*marked as complete"
-         << "*awaiting payment.\n" << endl;
+    io << "Order for table " << tableId << ": "
+       << "*marked as complete"
+       << "*awaiting payment.\n\n";
 }
 
-void payForOrder() {
-    int tableId = checkOrderAndTableStatus("Enter table number to pay: ");
-    if (tableId == -1) return;
+Task payForOrder(SessionIo& io) {
+    if (!showPendingTables(io)) co_return;
+    int tableId = co_await io.askNumber(1, tableQty, "Enter table number to pay: ");
 
-    if (!orders.count(tableId)) {
-        cerr << "No order found for Table " << tableId << ".\n";
-        return;
+    Bill bill;
+    OpResult quoted = engine.quote(tableId, bill);
+    if (quoted == OpResult::NO_ORDER) {
+        io.error("No order found for Table " + to_string(tableId) + ".\n");
+        co_return;
     }
 
-    Order& order = orders[tableId];
-
     //Prevent payment if the order isn't completed yet
-    if (!order.isCompleted) {
-        cerr << "Order for Table " << tableId << " is not completed yet!" << endl;
-        cerr << "Please complete the order before payment.\n" << endl;
-        return;
+    if (quoted == OpResult::NOT_COMPLETED) {
+        io.error("Order for Table " + to_string(tableId) + " is not completed yet!\n"
+                 "Please complete the order before payment.\n\n");
+        co_return;
+    }
+    if (quoted == OpResult::ALREADY_PAID) {
+        io.error("Table " + to_string(tableId) + " has already paid.\n");
+        co_return;
     }
 
-    int subtotal = 0;
-    for (Entrees item : order.items)
-        subtotal += entreePrices[item];
-
-    double tax = subtotal * TAX_RATE;
-    double tip = subtotal * TIP_RATE;
-    double total = subtotal + tax + tip;
-
-    cout << fixed << setprecision(2);
-    cout << "Subtotal: $" << subtotal << "\n";
-    cout << "Tax: $" << tax << "\n";
-    cout << "Tip: $" << tip << "\n";
-    cout << "Total: $" << total << "\n";
+    io << "Subtotal: $" << bill.subtotal << "\n";
+    io << "Tax: $" << bill.tax << "\n";
+    io << "Tip: $" << bill.tip << "\n";
+    io << "Total: $" << bill.total << "\n";
 
-    char confirm;
-    cout << "Confirm payment? (y/n): ";
-    cin >> confirm;
+    char confirm = co_await io.askChar("Confirm payment? (y/n): ");
 
     if (tolower(confirm) == 'y') {
-        order.isPaid = true;
-        tables[tableId].seatedGuests = 0;
-
-        int transId = rand() % 9000 + 1000; // random 4-digit ID (1000–9999)
-        string filename = "Transaction#" + to_string(transId) + ".txt";
-        ofstream out(filename);
-        out << "*** RECEIPT FOR TABLE " << tableId << " ***\n";
-        out << "-------------------------\n";
-        for (Entrees item : order.items)
-            out << entreeNames[item] << " - $" << entreePrices[item] << "\n";
-        out << "-------------------------\n";
-        out << fixed << setprecision(2);
-        out << "Subtotal: $" << subtotal << "\n";
-        out << "Tip (20%): $" << tip << "\n";
-        out << "Tax (10%): $" << tax << "\n";
-        out << "Total: $" << total << "\n";
-        out.close();
-
-        cout << "Payment successful. Receipt saved to '" << filename << "'.\n";
+        uint64_t transId = 0;
+        OpResult paid = engine.pay(tableId, transId);
+        if (paid != OpResult::OK)
+            io.error("Payment for Table " + to_string(tableId) + " failed: " + describe(paid) + ".\n");
+        else if (receiptJournal)
+            io << "Payment successful. Receipt #" << transId << " recorded in the receipt journal.\n";
+        else
+            io << "Payment successful. Receipt saved to 'Transaction#" << transId << ".txt'.\n";
     } else {
-        cout << "Payment cancelled.\n";
+        io << "Payment cancelled.\n";
     }
 }
 
-void showMenuOptions() {
-    cout << "\n--- MESSIJOE'S MAIN MENU ---\n";
-    cout << "1. Enter Order\n";
+void showMenuOptions(SessionIo& io) {
+    io << "\n--- MESSIJOE'S MAIN MENU ---\n";
+    io << "1. Enter Order\n";
 
-    if (!(orders.empty()) && !allOrdersPaidAndComplete()) 
+    if (!(orders.empty()) && !allOrdersPaidAndComplete())
     {
-        cout << "2. Complete Order\n";
-        cout << "3. Calculate and Pay Bill\n";
+        io << "2. Complete Order\n";
+        io << "3. Calculate and Pay Bill\n";
     }
-    if (!(orders.empty()) && allOrdersPaidAndComplete())
-        cout << "4. Close the Restaurant\n";
+    if (orders.hadOrders() && allOrdersPaidAndComplete())
+        io << "4. Close the Restaurant\n";
 }
 
-int main() {
-    initializeTables();
+// One terminal's whole conversation, from the main menu until it closes the
+// restaurant.
+Task terminalSession(SessionIo& io) {
     bool inService = true;
 
     while (inService) {
-        showMenuOptions();
-        int choice = checkNum(1, 4, "Choose an option: ");
+        showMenuOptions(io);
+        int choice = co_await io.askNumber(1, 4, "Choose an option: ");
 
         switch (choice) {
             case 1:
-                placeOrder();
+                co_await placeOrder(io);
                 break;
             case 2:
                 if (!(orders.empty()) && !allOrdersPaidAndComplete()) {
-                    completeOrder();
+                    co_await completeOrder(io);
                 } else {
-                    cout << "No orders available to complete.\n";
+                    io << "No orders available to complete.\n";
                 }
                 break;
             case 3:
                 if (!(orders.empty()) && !allOrdersPaidAndComplete()) {
-                    payForOrder();
+                    co_await payForOrder(io);
                 } else {
-                    cout << "No unpaid orders available.\n";
+                    io << "No unpaid orders available.\n";
                 }
                 break;
             case 4:
-                if (!(orders.empty()) && allOrdersPaidAndComplete()) {
+                if (engine.close()) {
                     inService = false;
-                    cout << "Goodbye!\n";
+                    io << "Goodbye!\n";
+                } else {
+                    io << "Cannot close — orders still pending.\n";
+                }
+                break;
+            default:
+                io << "Invalid option. Please try again.\n";
+        }
+    }
+}
+
+// Drives a single session from the console until it closes the restaurant
+// or input runs out.
+void runConsoleSession() {
+    SessionIo io(&console);
+    Task session = terminalSession(io);
+    session.start();
+    while (!session.done()) {
+        if (io.wantsChar()) {
+            char confirm = 'n';
+            input.readChar(confirm);
+            io.provideChar(confirm);
+            continue;
+        }
+        int value = 0;
+        bool parsed = input.readInt(value, true);
+        if (!parsed && input.atEnd()) return; // nothing more will ever arrive
+        if (!io.provideNumber(parsed, value)) input.skipLine();
+    }
+}
+
+// Multiplexes many terminal sessions on one thread from a replay stream.
+// Each line is "<session id> <input>"; the input answers that session's
+// current prompt, and a session starts the first time its ID appears. A
+// session in progress costs its coroutine frames, not a thread. Screen text
+// is echoed with a "[id] " prefix unless the console is quiet.
+int runSessions(const string& path) {
+    FILE* file = path == "-" ? stdin : fopen(path.c_str(), "rb");
+    if (!file) {
+        consoleErr << "Cannot open session input '" << path << "'.\n";
+        return 1;
+    }
+
+    struct Session {
+        SessionIo io{nullptr, console.quiet};
+        Task task = terminalSession(io);
+    };
+    unordered_map<int, unique_ptr<Session>> sessions;
+    InputReader lines(fileno(file), false);
+    size_t inputs = 0, started = 0, finished = 0, lineNo = 0;
+    auto began = chrono::steady_clock::now();
+
+    auto echo = [&](int id, TextBuffer& text) {
+        if (!console.quiet) {
+            string_view rest = text.str();
+            while (!rest.empty()) {
+                size_t nl = rest.find('\n');
+                size_t n = nl == string_view::npos ? rest.size() : nl + 1;
+                console << '[' << id << "] " << rest.substr(0, n);
+                rest.remove_prefix(n);
+            }
+            if (text.size() && text.str().back() != '\n') console << '\n';
+        }
+        text.clear();
+    };
+
+    while (!lines.atEnd()) {
+        ++lineNo;
+        int id = 0;
+        if (!lines.readInt(id, false)) {
+            string_view word = lines.word();
+            if (!word.empty() && word[0] != '#')
+                consoleErr << "line " << lineNo << ": expected a session id\n";
+            lines.skipLine();
+            continue;
+        }
+
+        unique_ptr<Session>& session = sessions[id];
+        if (!session) {
+            session = make_unique<Session>();
+            session->task.start();
+            ++started;
+        }
+        ++inputs;
+        if (session->io.wantsChar()) {
+            string_view word = lines.word();
+            session->io.provideChar(word.empty() ? 'n' : word[0]);
+        } else {
+            int value = 0;
+            bool parsed = lines.readInt(value, false);
+            session->io.provideNumber(parsed, value);
+        }
+        lines.skipLine();
+
+        echo(id, session->io.text());
+        if (session->task.done()) {
+            sessions.erase(id);
+            ++finished;
+        }
+    }
+    if (file != stdin) fclose(file);
+
+    receiptWriter->drain();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - began).count();
+    consoleErr << "Sessions: " << inputs << " inputs, " << started << " started, "
+               << finished << " finished, " << seconds << " s\n";
+    return 0;
+}
+
+enum class CommandType : uint8_t { PLACE, COMPLETE, PAY, VOID };
+
+// Fixed-size unit of work a terminal hands to the engine.
+struct Command {
+    CommandType type = CommandType::PLACE;
+    uint8_t guests = 0;
+    uint16_t terminal = 0;
+    int32_t tableId = 0;
+    uint64_t ticket = 0;
+    array<Entrees, MAX_PARTY> items{};
+};
+
+OpResult applyCommand(const Command& cmd, uint64_t& transId) {
+    switch (cmd.type) {
+        case CommandType::PLACE: {
+            if (cmd.tableId == 0 && cmd.guests > TABLE_CAPACITY) {
+                vector<int> tableIds;
+                return engine.placeGroup(cmd.items.data(), cmd.guests, tableIds);
+            }
+            if (cmd.tableId == 0) {
+                int tableId = 0;
+                return engine.placeAnywhere(cmd.items.data(), cmd.guests, tableId);
+            }
+            return engine.place(cmd.tableId, cmd.items.data(), cmd.guests);
+        }
+        case CommandType::COMPLETE:
+            return engine.complete(cmd.tableId);
+        case CommandType::PAY:
+            return engine.pay(cmd.tableId, transId);
+        case CommandType::VOID:
+            return engine.voidOrder(cmd.tableId);
+    }
+    return OpResult::OK;
+}
+
+// Single-writer alternative to calling the engine from every terminal.
+// Terminals push commands into one lock-free ring; a single engine thread
+// applies them in arrival order, draining the ring in batches, and posts each
+// outcome to the submitting terminal's completion slot. A terminal may keep
+// up to PIPELINE_DEPTH commands in flight, and must wait() for a ticket
+// before submitting the one that reuses its slot (ticket + PIPELINE_DEPTH).
+class CommandPipeline {
+public:
+    explicit CommandPipeline(int terminalQty)
+        : ring(COMMAND_RING_CAPACITY), terminals(new Terminal[terminalQty]),
+          worker([this] { run(); }) {}
+
+    ~CommandPipeline() { stop(); }
+
+    uint64_t submit(Command cmd) {
+        cmd.ticket = ++terminals[cmd.terminal].issued;
+        while (!ring.tryPush(move(cmd)))
+            this_thread::yield();
+        return cmd.ticket;
+    }
+
+    OpResult wait(int terminal, uint64_t ticket, uint64_t& transId) {
+        const Slot& slot = terminals[terminal].slots[ticket % PIPELINE_DEPTH];
+        for (int spins = 0; slot.ticket.load(memory_order_acquire) != ticket; ++spins) {
+            if (spins > 64) this_thread::yield();
+        }
+        transId = slot.transId;
+        return slot.result;
+    }
+
+    void stop() {
+        if (!worker.joinable()) return;
+        stopping.store(true, memory_order_release);
+        worker.join();
+    }
+
+private:
+    struct alignas(64) Slot {
+        atomic<uint64_t> ticket{0};
+        OpResult result = OpResult::OK;
+        uint64_t transId = 0;
+    };
+
+    struct Terminal {
+        uint64_t issued = 0; // only touched by the terminal's own thread
+        Slot slots[PIPELINE_DEPTH];
+    };
+
+    void run() {
+        array<Command, 256> batch;
+        for (int idle = 0;;) {
+            size_t n = 0;
+            while (n < batch.size() && ring.tryPop(batch[n])) ++n;
+            if (n == 0) {
+                if (stopping.load(memory_order_acquire)) return;
+                if (++idle > 64) this_thread::yield();
+                continue;
+            }
+            idle = 0;
+            for (size_t i = 0; i < n; ++i) {
+                const Command& cmd = batch[i];
+                Slot& slot = terminals[cmd.terminal].slots[cmd.ticket % PIPELINE_DEPTH];
+                slot.result = applyCommand(cmd, slot.transId);
+                slot.ticket.store(cmd.ticket, memory_order_release);
+            }
+        }
+    }
+
+    BoundedQueue<Command> ring;
+    unique_ptr<Terminal[]> terminals;
+    atomic<bool> stopping{false};
+    thread worker;
+};
+
+struct BatchStats {
+    size_t processed = 0;
+    size_t rejected = 0;
+    bool closed = false;
+};
+
+void reportRejected(TextBuffer& errors, string_view source, size_t lineNo, int tableId, OpResult result) {
+    errors << source << "line " << lineNo << ": ";
+    if (tableId) errors << "table " << tableId << ": ";
+    errors << describe(result) << "\n";
+}
+
+// Batch commands that run on the reading thread rather than through the engine.
+enum class DirectCommand : uint8_t { NONE, CLOSE, PRICE, EIGHTY_SIX, STOCK, PANTRY, CAN_MAKE, INGREDIENTS, BUMP };
+
+// Applies a manager command or answers a query into answers. Everything but
+// ingredient and station refers to an item by SKU.
+OpResult applyDirect(DirectCommand direct, int sku, int count, Money price, int ingredient, int station,
+                     TextBuffer& answers) {
+    switch (direct) {
+        case DirectCommand::PRICE:
+        case DirectCommand::EIGHTY_SIX: {
+            bool restock = direct == DirectCommand::PRICE;
+            return engine.changeMenu(uint32_t(sku), [&](MenuCatalog& next, Entrees item) {
+                if (restock) next.setPrice(item, price);
+                next.setAvailable(item, restock);
+            });
+        }
+        case DirectCommand::PANTRY:
+            if (ingredient < 0) return OpResult::NO_SUCH_INGREDIENT;
+            recipes.setOnHand(uint32_t(ingredient), count);
+            return OpResult::OK;
+        case DirectCommand::INGREDIENTS:
+            for (uint32_t j = 0; j < recipes.ingredientQty(); ++j) {
+                answers << recipes.ingredientName(j) << ": " << recipes.used(j) << " used";
+                if (int64_t left = recipes.onHand(j); left != RecipeBook::UNCOUNTED) answers << ", " << left << " left";
+                answers << "\n";
+            }
+            return OpResult::OK;
+        case DirectCommand::BUMP: {
+            if (station < 0) return OpResult::NO_SUCH_STATION;
+            KitchenTicket ticket;
+            bool orderCompleted = false;
+            OpResult result = engine.bump(station, ticket, orderCompleted);
+            if (result != OpResult::OK) return result;
+            MenuView menu;
+            answers << kitchen.stationName(station) << ": table " << ticket.tableId << " " << menu->name(ticket.item);
+            if (orderCompleted) answers << ", table " << ticket.tableId << " ready";
+            answers << "\n";
+            return OpResult::OK;
+        }
+        default:
+            break;
+    }
+    MenuView menu;
+    Entrees item = menu->find(uint32_t(sku));
+    if (item == NO_ITEM) return OpResult::INVALID_ITEM;
+    if (direct == DirectCommand::STOCK) {
+        stock.set(item, count);
+    } else if (direct == DirectCommand::CAN_MAKE) {
+        int64_t left = recipes.portionsLeft(item);
+        answers << menu->name(item) << " x" << count << ": ";
+        if (left == RecipeBook::UNCOUNTED) answers << "yes (ingredients not counted)\n";
+        else answers << (left >= count ? "yes" : "no") << " (" << left << " left)\n";
+    }
+    return OpResult::OK;
+}
+
+// Runs a command stream without prompts. One command per line:
+//   place <table> <item> [<item>...]   (alias p; one guest per item;
+//                                       table 0 lets the seating policy pick,
+//                                       joining tables for over 4 guests)
+//   complete <table>                   (alias c)
+//   pay <table>                        (alias $)
+//   void <table>                       (alias v; cancels an unpaid order)
+//   price <item> <price>               (sets the price; puts an 86'd item back)
+//   86 <item>                          (takes the item off the menu)
+//   stock <item> <count>               (portions left; -1 stops counting)
+//   pantry <ingredient> <amount>       (amount on hand; -1 stops counting)
+//   canmake <item> <n>                 (answers whether n more can be made)
+//   ingredients                        (reports use of every ingredient)
+//   bump <station>                     (finishes the station's next ticket)
+//   close                              (alias x; ends the stream)
+// Blank lines and lines starting with '#' are ignored. Rejected commands are
+// described in errors with their line number, and queries are answered in
+// answers; everything else stays silent. Commands are applied directly on
+// this thread, or, given a pipeline, sent to its engine thread as terminal
+// number `terminal`.
+BatchStats replayCommands(FILE* file, string_view source, TextBuffer& errors, TextBuffer& answers,
+                          CommandPipeline* pipeline, int terminal) {
+    InputReader commands(fileno(file), false);
+    BatchStats stats;
+    size_t lineNo = 0;
+
+    struct InFlight {
+        uint64_t ticket;
+        size_t lineNo;
+        int tableId;
+    };
+    array<InFlight, PIPELINE_DEPTH> inFlight;
+    size_t oldest = 0, pending = 0;
+    auto retireOldest = [&] {
+        const InFlight& cmd = inFlight[oldest];
+        uint64_t transId = 0;
+        OpResult result = pipeline->wait(terminal, cmd.ticket, transId);
+        if (result != OpResult::OK) {
+            ++stats.rejected;
+            reportRejected(errors, source, cmd.lineNo, cmd.tableId, result);
+        }
+        oldest = (oldest + 1) % PIPELINE_DEPTH;
+        --pending;
+    };
+
+    while (!stats.closed && !commands.atEnd()) {
+        ++lineNo;
+        string_view word = commands.word();
+        if (word.empty() || word[0] == '#') {
+            commands.skipLine();
+            continue;
+        }
+
+        ++stats.processed;
+        Command cmd;
+        cmd.terminal = uint16_t(terminal);
+        OpResult result = OpResult::OK;
+        bool syntaxOk = true;
+        DirectCommand direct = DirectCommand::NONE;
+        int tableId = 0, sku = 0, count = 0, ingredient = -1, station = -1;
+        Money price;
+        if (word == "place" || word == "p") {
+            int choice = 0;
+            cmd.type = CommandType::PLACE;
+            syntaxOk = commands.readInt(tableId, false);
+            MenuView menu;
+            int guests = 0;
+            while (syntaxOk && commands.readInt(choice, false)) {
+                if (guests < MAX_PARTY)
+                    cmd.items[guests] = choice < 1 ? NO_ITEM : menu->find(uint32_t(choice));
+                ++guests;
+            }
+            cmd.guests = uint8_t(min(guests, MAX_PARTY));
+            if (syntaxOk && guests == 0) syntaxOk = false;
+            else if (guests > (tableId == 0 ? MAX_PARTY : TABLE_CAPACITY)) result = OpResult::TABLE_FULL;
+        } else if (word == "complete" || word == "c") {
+            cmd.type = CommandType::COMPLETE;
+            syntaxOk = commands.readInt(tableId, false);
+        } else if (word == "pay" || word == "$") {
+            cmd.type = CommandType::PAY;
+            syntaxOk = commands.readInt(tableId, false);
+        } else if (word == "void" || word == "v") {
+            cmd.type = CommandType::VOID;
+            syntaxOk = commands.readInt(tableId, false);
+        } else if (word == "price") {
+            direct = DirectCommand::PRICE;
+            syntaxOk = commands.readInt(sku, false) && sku > 0 && Money::parse(commands.word(), price);
+        } else if (word == "86") {
+            direct = DirectCommand::EIGHTY_SIX;
+            syntaxOk = commands.readInt(sku, false) && sku > 0;
+        } else if (word == "stock") {
+            direct = DirectCommand::STOCK;
+            syntaxOk = commands.readInt(sku, false) && sku > 0 && commands.readInt(count, false)
+                    && count >= Inventory::UNCOUNTED;
+        } else if (word == "pantry") {
+            direct = DirectCommand::PANTRY;
+            ingredient = recipes.find(commands.word());
+            syntaxOk = commands.readInt(count, false) && count >= RecipeBook::UNCOUNTED;
+        } else if (word == "canmake") {
+            direct = DirectCommand::CAN_MAKE;
+            syntaxOk = commands.readInt(sku, false) && sku > 0 && commands.readInt(count, false) && count >= 0;
+        } else if (word == "ingredients") {
+            direct = DirectCommand::INGREDIENTS;
+        } else if (word == "bump") {
+            direct = DirectCommand::BUMP;
+            station = kitchen.find(commands.word());
+        } else if (word == "close" || word == "x") {
+            direct = DirectCommand::CLOSE;
+        } else {
+            syntaxOk = false;
+        }
+        if (syntaxOk && !commands.atLineEnd()) syntaxOk = false;
+        commands.skipLine();
+        cmd.tableId = tableId;
+
+        // Settle everything in flight first so errors come out in line order,
+        // and so direct commands see the effect of every earlier line.
+        if (!syntaxOk || direct != DirectCommand::NONE || result != OpResult::OK) {
+            while (pending > 0) retireOldest();
+        }
+        if (!syntaxOk) {
+            ++stats.rejected;
+            errors << source << "line " << lineNo << ": cannot parse command\n";
+            continue;
+        }
+        if (direct == DirectCommand::CLOSE) {
+            if (engine.close()) stats.closed = true;
+            else result = OpResult::ORDERS_PENDING;
+        } else if (direct != DirectCommand::NONE) {
+            result = applyDirect(direct, sku, count, price, ingredient, station, answers);
+        } else if (result == OpResult::OK && pipeline) {
+            if (pending == PIPELINE_DEPTH) retireOldest();
+            inFlight[(oldest + pending) % PIPELINE_DEPTH] = {pipeline->submit(cmd), lineNo, tableId};
+            ++pending;
+            continue;
+        } else if (result == OpResult::OK) {
+            uint64_t transId = 0;
+            result = applyCommand(cmd, transId);
+        }
+        if (result != OpResult::OK) {
+            ++stats.rejected;
+            reportRejected(errors, source, lineNo, tableId, result);
+        }
+    }
+    while (pending > 0) retireOldest();
+    return stats;
+}
+
+// Replays each command stream ("-" is stdin). With more than one stream,
+// each gets its own thread, like terminals sharing one engine. With
+// usePipeline, the terminals feed a single engine thread instead of applying
+// commands themselves. memStats reports what the tables and orders occupy.
+int runBatch(const vector<string>& paths, bool usePipeline, bool memStats) {
+    vector<FILE*> files;
+    for (const string& path : paths) {
+        FILE* file = path == "-" ? stdin : fopen(path.c_str(), "rb");
+        if (!file) {
+            consoleErr << "Cannot open batch input '" << path << "'.\n";
+            return 1;
+        }
+        files.push_back(file);
+    }
+
+    auto started = chrono::steady_clock::now();
+    unique_ptr<CommandPipeline> pipeline;
+    if (usePipeline) pipeline = make_unique<CommandPipeline>(int(files.size()));
+    vector<BatchStats> stats(files.size());
+    vector<TextBuffer> errors(files.size());
+    vector<TextBuffer> answers(files.size());
+    vector<string> sources(files.size());
+    if (files.size() == 1) {
+        stats[0] = replayCommands(files[0], "", errors[0], answers[0], pipeline.get(), 0);
+    } else {
+        vector<thread> terminals;
+        for (size_t i = 0; i < files.size(); ++i) {
+            sources[i] = paths[i] + ": ";
+            terminals.emplace_back([&, i] {
+                stats[i] = replayCommands(files[i], sources[i], errors[i], answers[i], pipeline.get(), int(i));
+            });
+        }
+        for (thread& terminal : terminals)
+            terminal.join();
+    }
+    if (pipeline) pipeline->stop();
+    receiptWriter->drain();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+    size_t processed = 0, rejected = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (files[i] != stdin) fclose(files[i]);
+        console << answers[i].str();
+        consoleErr << errors[i].str();
+        processed += stats[i].processed;
+        rejected += stats[i].rejected;
+    }
+    consoleErr << "Batch: " << processed << " commands, " << rejected << " rejected, " << seconds << " s";
+    if (files.size() == 1 && stats[0].closed) consoleErr << ", restaurant closed";
+    consoleErr << "\n";
+    if (memStats) {
+        size_t bytes = orders.memoryBytes() + tables.capacity() * sizeof(Table);
+        consoleErr << "Memory: " << orders.size() << " orders, " << bytes << " bytes";
+        if (!orders.empty()) consoleErr << ", " << double(bytes) / double(orders.size()) << " bytes per order";
+        consoleErr << "\n";
+    }
+    return rejected ? 2 : 0;
+}
+
+#ifdef __linux__
+// POS terminal protocol. Every message is a frame: a u16 body length, then
+// the body. Integers are in host byte order since both ends share a machine.
+//   request body:  u8 op, then per op
+//     OP_PLACE     u16 table, u8 guests, u32 item number (SKU) per guest;
+//                  table 0 lets the seating policy pick, joining tables
+//                  for more than TABLE_CAPACITY (up to MAX_PARTY) guests
+//     OP_COMPLETE  u16 table
+//     OP_PAY       u16 table
+//     OP_STATUS    u16 table
+//     OP_CLOSE     (nothing)
+//   response body: u8 op, u8 OpResult, then on success
+//     OP_PAY       u64 transaction id, i64 total in cents
+//     OP_STATUS    u8 OrderStatus
+// Requests may be pipelined; responses come back in request order.
+enum ServerOp : uint8_t { OP_PLACE = 1, OP_COMPLETE = 2, OP_PAY = 3, OP_STATUS = 4, OP_CLOSE = 5 };
+static_assert(4 + MAX_PARTY * sizeof(uint32_t) <= MAX_FRAME_BYTES, "a full party must fit in one frame");
+
+// Serves terminals over a Unix-domain socket from one thread: an epoll loop
+// that reads whatever each connection has sent, runs every complete frame
+// through the engine and queues the responses for writing.
+class TerminalServer {
+public:
+    explicit TerminalServer(string path) : path(move(path)) {}
+
+    ~TerminalServer() {
+        for (auto& [fd, conn] : connections) ::close(fd);
+        if (listener >= 0) {
+            ::close(listener);
+            unlink(path.c_str());
+        }
+        if (epoll >= 0) ::close(epoll);
+    }
+
+    bool start() {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path)) return false;
+        memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        unlink(path.c_str());
+
+        listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        epoll = epoll_create1(EPOLL_CLOEXEC);
+        if (listener < 0 || epoll < 0) return false;
+        if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) return false;
+        if (listen(listener, SOMAXCONN) < 0) return false;
+        return watch(listener, EPOLLIN, EPOLL_CTL_ADD);
+    }
+
+    // Runs until a terminal successfully closes the restaurant.
+    void run() {
+        epoll_event events[SERVER_MAX_EVENTS];
+        while (!closing) {
+            int n = epoll_wait(epoll, events, SERVER_MAX_EVENTS, -1);
+            for (int i = 0; i < n; ++i) {
+                int fd = events[i].data.fd;
+                if (fd == listener) {
+                    acceptAll();
+                    continue;
+                }
+                if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                    drop(fd);
+                    continue;
+                }
+                if ((events[i].events & EPOLLIN) && !readFrom(fd)) continue;
+                if (events[i].events & EPOLLOUT) writeTo(fd);
+            }
+        }
+        // Flush outstanding responses (including the close acknowledgement).
+        vector<int> open;
+        for (auto& [fd, conn] : connections) open.push_back(fd);
+        for (int fd : open) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+            writeTo(fd);
+        }
+    }
+
+private:
+    struct Connection {
+        string in;
+        string out;
+        size_t outPos = 0;
+        bool wantWrite = false;
+    };
+
+    bool watch(int fd, uint32_t events, int op) {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.fd = fd;
+        return epoll_ctl(epoll, op, fd, &ev) == 0;
+    }
+
+    void acceptAll() {
+        for (;;) {
+            int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) return;
+            connections[fd];
+            watch(fd, EPOLLIN, EPOLL_CTL_ADD);
+        }
+    }
+
+    void drop(int fd) {
+        epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+        connections.erase(fd);
+    }
+
+    // Returns false if the connection was dropped.
+    bool readFrom(int fd) {
+        Connection& conn = connections[fd];
+        char chunk[1 << 14];
+        for (;;) {
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n > 0) {
+                conn.in.append(chunk, size_t(n));
+                continue;
+            }
+            if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                drop(fd);
+                return false;
+            }
+            break;
+        }
+
+        size_t pos = 0;
+        while (conn.in.size() - pos >= sizeof(uint16_t)) {
+            uint16_t length;
+            memcpy(&length, conn.in.data() + pos, sizeof(length));
+            if (length == 0 || length > MAX_FRAME_BYTES) {
+                drop(fd);
+                return false;
+            }
+            if (conn.in.size() - pos - sizeof(length) < length) break;
+            handle(reinterpret_cast<const uint8_t*>(conn.in.data() + pos + sizeof(length)), length, conn.out);
+            pos += sizeof(length) + length;
+        }
+        conn.in.erase(0, pos);
+        writeTo(fd);
+        return connections.count(fd) != 0;
+    }
+
+    void writeTo(int fd) {
+        Connection& conn = connections[fd];
+        while (conn.outPos < conn.out.size()) {
+            ssize_t n = send(fd, conn.out.data() + conn.outPos, conn.out.size() - conn.outPos, MSG_NOSIGNAL);
+            if (n <= 0) {
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                drop(fd);
+                return;
+            }
+            conn.outPos += size_t(n);
+        }
+        if (conn.outPos == conn.out.size()) {
+            conn.out.clear();
+            conn.outPos = 0;
+        }
+        bool wantWrite = !conn.out.empty();
+        if (wantWrite != conn.wantWrite) {
+            conn.wantWrite = wantWrite;
+            watch(fd, wantWrite ? EPOLLIN | EPOLLOUT : EPOLLIN, EPOLL_CTL_MOD);
+        }
+    }
+
+    template <typename T>
+    static void put(string& out, T value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void handle(const uint8_t* body, size_t length, string& out) {
+        uint8_t op = body[0];
+        auto table = [&] {
+            uint16_t tableId = 0;
+            if (length >= 3) memcpy(&tableId, body + 1, sizeof(tableId));
+            return int(tableId);
+        };
+
+        OpResult result = OpResult::OK;
+        string payload;
+        switch (op) {
+            case OP_PLACE: {
+                array<Entrees, MAX_PARTY> items;
+                int guests = length >= 4 ? body[3] : 0;
+                int seatable = table() == 0 ? MAX_PARTY : TABLE_CAPACITY;
+                if (guests < 1 || guests > seatable || length != 4 + guests * sizeof(uint32_t)) {
+                    result = guests > seatable ? OpResult::TABLE_FULL : OpResult::INVALID_ITEM;
+                    break;
+                }
+                MenuView menu;
+                for (int i = 0; i < guests; ++i) {
+                    uint32_t sku;
+                    memcpy(&sku, body + 4 + i * sizeof(sku), sizeof(sku));
+                    items[i] = menu->find(sku);
+                }
+                if (table() == 0 && guests > TABLE_CAPACITY) {
+                    vector<int> tableIds;
+                    result = engine.placeGroup(items.data(), guests, tableIds);
+                } else if (table() == 0) {
+                    int tableId = 0;
+                    result = engine.placeAnywhere(items.data(), guests, tableId);
                 } else {
-                    cout << "Cannot close — orders still pending.\n";
+                    result = engine.place(table(), items.data(), guests);
+                }
+                break;
+            }
+            case OP_COMPLETE:
+                result = engine.complete(table());
+                break;
+            case OP_PAY: {
+                uint64_t transId = 0;
+                Bill bill;
+                result = engine.pay(table(), transId, &bill);
+                if (result == OpResult::OK) {
+                    put(payload, transId);
+                    put(payload, bill.total.cents);
+                }
+                break;
+            }
+            case OP_STATUS: {
+                int tableId = table();
+                if (tableId < 1 || tableId > tableQty) {
+                    result = OpResult::NO_SUCH_TABLE;
+                    break;
                 }
+                put(payload, uint8_t(engine.status(tableId)));
+                break;
+            }
+            case OP_CLOSE:
+                if (engine.close()) closing = true;
+                else result = OpResult::ORDERS_PENDING;
                 break;
             default:
-                cout << "Invalid option. Please try again.\n";
+                result = OpResult::INVALID_ITEM;
+        }
+
+        put(out, uint16_t(2 + payload.size()));
+        put(out, op);
+        put(out, uint8_t(result));
+        out += payload;
+    }
+
+    const string path;
+    int listener = -1;
+    int epoll = -1;
+    bool closing = false;
+    unordered_map<int, Connection> connections;
+};
+#endif
+
+int main(int argc, char* argv[]) {
+    Durability durability = Durability::FIRE_AND_FORGET;
+    chrono::milliseconds commitInterval(0);
+    vector<string> batchInputs;
+    string sessionInput;
+    string walPath;
+    bool walFsync = false;
+    uint64_t snapshotEvery = SNAPSHOT_EVERY_EVENTS;
+    string socketPath;
+    bool usePipeline = false;
+    bool memStats = false;
+    string floorPlanPath;
+    string recipesPath;
+    string kitchenPath;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--journal") {
+            receiptJournal = make_unique<ReceiptJournal>(RECEIPT_JOURNAL_PREFIX);
+        } else if (arg == "--durability=none") {
+            durability = Durability::FIRE_AND_FORGET;
+        } else if (arg.rfind("--durability=group:", 0) == 0) {
+            durability = Durability::GROUP_COMMIT;
+            commitInterval = chrono::milliseconds(max(1L, atol(arg.c_str() + 19)));
+        } else if (arg == "--quiet") {
+            console.quiet = true;
+        } else if (arg == "--batch" && i + 1 < argc) {
+            batchInputs.push_back(argv[++i]);
+        } else if (arg == "--serve" && i + 1 < argc) {
+            socketPath = argv[++i];
+        } else if (arg == "--sessions" && i + 1 < argc) {
+            sessionInput = argv[++i];
+        } else if (arg == "--wal" && i + 1 < argc) {
+            walPath = argv[++i];
+        } else if (arg == "--wal-fsync") {
+            walFsync = true;
+        } else if (arg == "--snapshot-every" && i + 1 < argc) {
+            snapshotEvery = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--seating=best-fit") {
+            seatingPolicy = SeatingPolicy::BEST_FIT;
+        } else if (arg == "--seating=least-recent") {
+            seatingPolicy = SeatingPolicy::LEAST_RECENTLY_TURNED;
+        } else if (arg == "--menu" && i + 1 < argc) {
+            string error;
+            MenuCatalog loaded;
+            if (!MenuCatalog::load(argv[++i], loaded, error)) {
+                cerr << "Cannot load menu: " << error << ".\n";
+                return 1;
+            }
+            menuBoard.publish(move(loaded));
+        } else if (arg == "--floorplan" && i + 1 < argc) {
+            floorPlanPath = argv[++i];
+        } else if (arg == "--recipes" && i + 1 < argc) {
+            recipesPath = argv[++i];
+        } else if (arg == "--kitchen" && i + 1 < argc) {
+            kitchenPath = argv[++i];
+        } else if (arg == "--kitchen-policy=fifo") {
+            kitchenPolicy = KitchenPolicy::FIFO;
+        } else if (arg == "--kitchen-policy=shortest-prep") {
+            kitchenPolicy = KitchenPolicy::SHORTEST_PREP_FIRST;
+        } else if (arg == "--kitchen-policy=table-fire") {
+            kitchenPolicy = KitchenPolicy::TABLE_FIRE;
+        } else if (arg == "--memstats") {
+            memStats = true;
+        } else if (arg == "--pipeline") {
+            usePipeline = true;
+        } else if (arg == "--tables" && i + 1 < argc) {
+            tableQty = max(1, atoi(argv[++i]));
+        } else if (arg == "--render-receipt" && i + 1 < argc) {
+            ReceiptRecord receipt;
+            uint64_t transId = strtoull(argv[++i], nullptr, 10);
+            if (!ReceiptJournal(RECEIPT_JOURNAL_PREFIX).find(transId, receipt)) {
+                cerr << "Receipt #" << transId << " not found in the receipt journal.\n";
+                return 1;
+            }
+            renderReceipt(cout, receipt);
+            return 0;
+        } else {
+            cerr << "Usage: " << argv[0] << " [--menu <file>] [--journal] [--durability=none|group:<ms>]"
+                 << " [--recipes <file>]\n"
+                 << "           [--kitchen <file> [--kitchen-policy=fifo|shortest-prep|table-fire]]\n"
+                 << "           [--tables <n>] [--seating=best-fit|least-recent] [--floorplan <file>]\n"
+                 << "           [--wal <file> [--wal-fsync] [--snapshot-every <n>]]"
+                 << " [--batch <file|->]... [--pipeline] [--quiet] [--memstats]\n"
+                 << "       " << argv[0] << " [--tables <n>] --serve <socket path>\n"
+                 << "       " << argv[0] << " [--tables <n>] [--quiet] --sessions <file|->\n"
+                 << "       " << argv[0] << " [--menu <file>] --render-receipt <transaction id>\n";
+            return 1;
+        }
+    }
+
+    if (!floorPlanPath.empty() && !FloorPlan::load(floorPlanPath, tableQty, floorPlan)) {
+        cerr << "Cannot read floor plan '" << floorPlanPath << "'.\n";
+        return 1;
+    }
+    // Recipes and kitchen routes refer to menu positions, so they are read
+    // once the menu is final.
+    if (!recipesPath.empty()) {
+        string error;
+        if (!RecipeBook::load(recipesPath, recipes, error)) {
+            cerr << "Cannot load recipes: " << error << ".\n";
+            return 1;
+        }
+    }
+    if (!kitchenPath.empty()) {
+        string error;
+        if (!Kitchen::load(kitchenPath, kitchen, error)) {
+            cerr << "Cannot load kitchen stations: " << error << ".\n";
+            return 1;
+        }
+    }
+    receiptWriter = make_unique<ReceiptWriter>(receiptJournal.get(), durability, commitInterval);
+    initializeTables();
+    unique_ptr<WriteAheadLog> wal;
+    unique_ptr<SnapshotScheduler> snapshots;
+    if (!walPath.empty()) {
+        wal = make_unique<WriteAheadLog>(walPath, walFsync);
+        auto started = chrono::steady_clock::now();
+        bool fromSnapshot = false;
+        size_t replayed = engine.recover(*wal, fromSnapshot);
+        if (replayed > 0 || fromSnapshot) {
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+            cerr << "Recovered " << (fromSnapshot ? "snapshot + " : "") << replayed
+                 << " events from '" << walPath << "' in " << ms << " ms.\n";
+        }
+        if (snapshotEvery > 0) snapshots = make_unique<SnapshotScheduler>(*wal, snapshotEvery);
+    }
+    if (!batchInputs.empty())
+        return runBatch(batchInputs, usePipeline, memStats);
+    if (!sessionInput.empty())
+        return runSessions(sessionInput);
+    if (!socketPath.empty()) {
+#ifdef __linux__
+        TerminalServer server(socketPath);
+        if (!server.start()) {
+            cerr << "Cannot listen on '" << socketPath << "'.\n";
+            return 1;
         }
+        server.run();
+        receiptWriter->drain();
+        return 0;
+#else
+        cerr << "Server mode is only available on Linux.\n";
+        return 1;
+#endif
     }
 
+    runConsoleSession();
+    receiptWriter->drain();
     return 0;
 }